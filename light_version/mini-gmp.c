@@ -48,6 +48,25 @@ see https://www.gnu.org/licenses/.  */
 #include <stdlib.h>
 #include <string.h>
 
+/* The limb primitives below have faster variants for the default 64-bit
+   limb: unsigned __int128 where the compiler has it, UMULH on AArch64,
+   and MULX/ADCX/ADOX loops on x86-64 when built with -madx -mbmi2 (or a
+   -march that includes them). Define MINI_GMP_NO_ASM to keep the
+   portable C code. */
+#if !defined(MINI_GMP_LIMB_TYPE) && defined(__LP64__) \
+  && !defined(MINI_GMP_NO_ASM)
+#define GMP_LIMB_64 1
+#else
+#define GMP_LIMB_64 0
+#endif
+
+#if GMP_LIMB_64 && defined(__GNUC__) && defined(__x86_64__) \
+  && defined(__ADX__) && defined(__BMI2__)
+#define GMP_LIMB_ADX 1
+#else
+#define GMP_LIMB_ADX 0
+#endif
+
 #include "mini-gmp.h"
 
 #if !defined(MINI_GMP_DONT_USE_FLOAT_H)
@@ -129,6 +148,21 @@ see https://www.gnu.org/licenses/.  */
     (sl) = __x;								\
   } while (0)
 
+#if GMP_LIMB_64 && defined(__GNUC__) && defined(__aarch64__)
+#define gmp_umul_ppmm(w1, w0, u, v)					\
+  do {									\
+    mp_limb_t __u = (u), __v = (v);					\
+    __asm__ ("umulh %0, %1, %2" : "=r" (w1) : "r" (__u), "r" (__v));	\
+    (w0) = __u * __v;							\
+  } while (0)
+#elif GMP_LIMB_64 && defined(__SIZEOF_INT128__)
+#define gmp_umul_ppmm(w1, w0, u, v)					\
+  do {									\
+    unsigned __int128 __ww = (unsigned __int128) (u) * (v);		\
+    w0 = (mp_limb_t) __ww;						\
+    w1 = (mp_limb_t) (__ww >> 64);					\
+  } while (0)
+#else
 #define gmp_umul_ppmm(w1, w0, u, v)					\
   do {									\
     int LOCAL_GMP_LIMB_BITS = GMP_LIMB_BITS;				\
@@ -168,6 +202,7 @@ see https://www.gnu.org/licenses/.  */
       (w0) = (__x1 << (GMP_LIMB_BITS / 2)) + (__x0 & GMP_LLIMB_MASK);	\
     }									\
   } while (0)
+#endif
 
 #define gmp_udiv_qrnnd_preinv(q, r, nh, nl, d, di)			\
   do {									\
@@ -529,6 +564,73 @@ mpn_sub (mp_ptr rp, mp_srcptr ap, mp_size_t an, mp_srcptr bp, mp_size_t bn)
   return cy;
 }
 
+#if GMP_LIMB_ADX
+/* Both loops count a negative index up to zero with LEA and JRCXZ, which
+   leave the flags alone: MULX does not touch them either, so the carry
+   chains in CF (ADCX) and OF (ADOX) run through the whole loop. */
+
+mp_limb_t
+mpn_mul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
+{
+  mp_limb_t lo, hi, cl, zero;
+
+  assert (n >= 1);
+  up += n;
+  rp += n;
+  n = -n;
+
+  __asm__ ("xor	%k[zero], %k[zero]\n\t"
+	   "mov	%[zero], %[cl]\n"
+	   "1:\n\t"
+	   "mulx	(%[up],%[n],8), %[lo], %[hi]\n\t"
+	   "adcx	%[cl], %[lo]\n\t"
+	   "mov	%[lo], (%[rp],%[n],8)\n\t"
+	   "mov	%[hi], %[cl]\n\t"
+	   "lea	1(%[n]), %[n]\n\t"
+	   "jrcxz	2f\n\t"
+	   "jmp	1b\n"
+	   "2:\n\t"
+	   "adcx	%[zero], %[cl]"
+	   : [lo] "=&r" (lo), [hi] "=&r" (hi), [cl] "=&r" (cl),
+	     [zero] "=&r" (zero), [n] "+c" (n)
+	   : [up] "r" (up), [rp] "r" (rp), "d" (vl)
+	   : "cc", "memory");
+
+  return cl;
+}
+
+mp_limb_t
+mpn_addmul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
+{
+  mp_limb_t lo, hi, cl, zero;
+
+  assert (n >= 1);
+  up += n;
+  rp += n;
+  n = -n;
+
+  __asm__ ("xor	%k[zero], %k[zero]\n\t"
+	   "mov	%[zero], %[cl]\n"
+	   "1:\n\t"
+	   "mulx	(%[up],%[n],8), %[lo], %[hi]\n\t"
+	   "adcx	%[cl], %[lo]\n\t"
+	   "adox	(%[rp],%[n],8), %[lo]\n\t"
+	   "mov	%[lo], (%[rp],%[n],8)\n\t"
+	   "mov	%[hi], %[cl]\n\t"
+	   "lea	1(%[n]), %[n]\n\t"
+	   "jrcxz	2f\n\t"
+	   "jmp	1b\n"
+	   "2:\n\t"
+	   "adcx	%[zero], %[cl]\n\t"
+	   "adox	%[zero], %[cl]"
+	   : [lo] "=&r" (lo), [hi] "=&r" (hi), [cl] "=&r" (cl),
+	     [zero] "=&r" (zero), [n] "+c" (n)
+	   : [up] "r" (up), [rp] "r" (rp), "d" (vl)
+	   : "cc", "memory");
+
+  return cl;
+}
+#else
 mp_limb_t
 mpn_mul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
 {
@@ -577,6 +679,7 @@ mpn_addmul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
 
   return cl;
 }
+#endif
 
 mp_limb_t
 mpn_submul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
@@ -604,14 +707,38 @@ mpn_submul_1 (mp_ptr rp, mp_srcptr up, mp_size_t n, mp_limb_t vl)
   return cl;
 }
 
-mp_limb_t
-mpn_mul (mp_ptr rp, mp_srcptr up, mp_size_t un, mp_srcptr vp, mp_size_t vn)
-{
-  assert (un >= vn);
-  assert (vn >= 1);
-  assert (!GMP_MPN_OVERLAP_P(rp, un + vn, up, un));
-  assert (!GMP_MPN_OVERLAP_P(rp, un + vn, vp, vn));
+/* Multiplication thresholds, in limbs. Operands of at least
+   MUL_TOOM22_THRESHOLD limbs use Karatsuba, from MUL_TOOM33_THRESHOLD
+   limbs on Toom-3; likewise for squaring. The defaults can be
+   overridden at compile time with values reported by tune-mini-gmp.c. */
+#if TUNE_PROGRAM_BUILD
+mp_size_t mul_toom22_threshold = 16;
+mp_size_t mul_toom33_threshold = 96;
+mp_size_t sqr_toom2_threshold = 20;
+mp_size_t sqr_toom3_threshold = 160;
+#define MUL_TOOM22_THRESHOLD mul_toom22_threshold
+#define MUL_TOOM33_THRESHOLD mul_toom33_threshold
+#define SQR_TOOM2_THRESHOLD sqr_toom2_threshold
+#define SQR_TOOM3_THRESHOLD sqr_toom3_threshold
+#else
+#ifndef MUL_TOOM22_THRESHOLD
+#define MUL_TOOM22_THRESHOLD 16
+#endif
+#ifndef MUL_TOOM33_THRESHOLD
+#define MUL_TOOM33_THRESHOLD 96
+#endif
+#ifndef SQR_TOOM2_THRESHOLD
+#define SQR_TOOM2_THRESHOLD 20
+#endif
+#ifndef SQR_TOOM3_THRESHOLD
+#define SQR_TOOM3_THRESHOLD 160
+#endif
+#endif
 
+static void
+mpn_mul_basecase (mp_ptr rp, mp_srcptr up, mp_size_t un,
+		  mp_srcptr vp, mp_size_t vn)
+{
   /* We first multiply by the low order limb. This result can be
      stored, not added, to rp. We also avoid a loop for zeroing this
      way. */
@@ -626,19 +753,373 @@ mpn_mul (mp_ptr rp, mp_srcptr up, mp_size_t un, mp_srcptr vp, mp_size_t vn)
       rp += 1, vp += 1;
       rp[un] = mpn_addmul_1 (rp, up, un, vp[0]);
     }
-  return rp[un];
+}
+
+/* Set {rp, n} = |{ap, n} - {bp, m}|, where m is n or n - 1. Returns 1 if
+   the difference is negative. */
+static int
+mpn_absdiff_ext (mp_ptr rp, mp_srcptr ap, mp_size_t n,
+		 mp_srcptr bp, mp_size_t m)
+{
+  if ((m < n && ap[n-1] != 0) || mpn_cmp (ap, bp, m) >= 0)
+    {
+      gmp_assert_nocarry (mpn_sub (rp, ap, n, bp, m));
+      return 0;
+    }
+  gmp_assert_nocarry (mpn_sub_n (rp, bp, ap, m));
+  if (m < n)
+    rp[n-1] = 0;
+  return 1;
+}
+
+/* Scratch space needed by mpn_toom22_mul, including its recursive calls. */
+static mp_size_t
+mpn_toom22_mul_itch (mp_size_t n)
+{
+  mp_size_t l;
+
+  if (n < MUL_TOOM22_THRESHOLD)
+    return 0;
+  l = n - (n >> 1);
+  return 6 * l + 1 + mpn_toom22_mul_itch (l);
+}
+
+static void mpn_toom22_mul (mp_ptr, mp_srcptr, mp_srcptr, mp_size_t, mp_ptr);
+static void mpn_toom33_mul (mp_ptr, mp_srcptr, mp_srcptr, mp_size_t);
+
+static void
+mpn_mul_n_rec (mp_ptr rp, mp_srcptr ap, mp_srcptr bp, mp_size_t n, mp_ptr tp)
+{
+  if (n < MUL_TOOM22_THRESHOLD)
+    mpn_mul_basecase (rp, ap, n, bp, n);
+  else if (n < MUL_TOOM33_THRESHOLD)
+    mpn_toom22_mul (rp, ap, bp, n, tp);
+  else
+    mpn_toom33_mul (rp, ap, bp, n);
+}
+
+/* Karatsuba. With a = a1 B^l + a0 and b = b1 B^l + b0, l = ceil(n/2),
+
+     a b = a1 b1 B^2l + (a0 b0 + a1 b1 - (a0 - a1)(b0 - b1)) B^l + a0 b0
+
+   The outer products go straight to rp, the middle term is accumulated
+   in tp, which must have mpn_toom22_mul_itch (n) limbs. */
+static void
+mpn_toom22_mul (mp_ptr rp, mp_srcptr ap, mp_srcptr bp, mp_size_t n, mp_ptr tp)
+{
+  mp_size_t l, h, tn;
+  mp_ptr xp, yp, zp, sp;
+  int neg;
+
+  l = n - (n >> 1);
+  h = n >> 1;
+
+  xp = tp;
+  yp = xp + l;
+  zp = yp + l;
+  sp = zp + 2 * l;
+  tp = sp + 2 * l + 1;
+
+  neg = mpn_absdiff_ext (xp, ap, l, ap + l, h);
+  neg ^= mpn_absdiff_ext (yp, bp, l, bp + l, h);
+
+  mpn_mul_n_rec (rp, ap, bp, l, tp);
+  mpn_mul_n_rec (rp + 2 * l, ap + l, bp + l, h, tp);
+  mpn_mul_n_rec (zp, xp, yp, l, tp);
+
+  /* Middle term: a0 b0 + a1 b1 -/+ |a0 - a1| |b0 - b1| */
+  sp[2 * l] = mpn_add (sp, rp, 2 * l, rp + 2 * l, 2 * h);
+  if (neg)
+    gmp_assert_nocarry (mpn_add (sp, sp, 2 * l + 1, zp, 2 * l));
+  else
+    gmp_assert_nocarry (mpn_sub (sp, sp, 2 * l + 1, zp, 2 * l));
+
+  tn = mpn_normalized_size (sp, 2 * l + 1);
+  assert (tn <= 2 * n - l);
+  if (tn > 0)
+    gmp_assert_nocarry (mpn_add (rp + l, rp + l, 2 * n - l, sp, tn));
+}
+
+static void
+mpn_add_mpz_at (mp_ptr rp, mp_size_t rn, mp_size_t off, const mpz_t x)
+{
+  assert (x->_mp_size >= 0);
+  if (x->_mp_size > 0)
+    gmp_assert_nocarry (mpn_add (rp + off, rp + off, rn - off,
+				 x->_mp_d, x->_mp_size));
+}
+
+/* Toom-3, evaluating at 0, 1, -1, -2 and infinity. The pointwise
+   products of the outer points go straight to rp. Evaluation and the
+   interpolation sequence (Bodrato) work on signed values and are done
+   with mpz; their cost is linear, the three inner products recurse
+   through mpz_mul. */
+static void
+mpn_toom33_mul (mp_ptr rp, mp_srcptr ap, mp_srcptr bp, mp_size_t n)
+{
+  int sqr = ap == bp;
+  mp_size_t k, s;
+  mpz_t a0, a1, a2, b0, b1, b2, v0, vinf;
+  mpz_t x, y, v1, vm1, vm2;
+
+  k = (n + 2) / 3;
+  s = n - 2 * k;
+  assert (s > 0);
+
+  mpz_roinit_n (a0, ap, k);
+  mpz_roinit_n (a1, ap + k, k);
+  mpz_roinit_n (a2, ap + 2 * k, s);
+  mpz_roinit_n (b0, bp, k);
+  mpz_roinit_n (b1, bp + k, k);
+  mpz_roinit_n (b2, bp + 2 * k, s);
+
+  mpz_init (x);
+  mpz_init (y);
+  mpz_init (v1);
+  mpz_init (vm1);
+  mpz_init (vm2);
+
+  /* x = a0 + a2 +/- a1, and a0 - 2 a1 + 4 a2 = 2 (a0 - a1 + a2 + a2) - a0 */
+  /* For squares the b evaluations equal the a ones, and mpz_mul takes
+     its squaring path when both operands are the same. */
+  mpz_add (x, a0, a2);
+  mpz_add (v1, x, a1);
+  if (sqr)
+    mpz_mul (v1, v1, v1);
+  else
+    {
+      mpz_add (y, b0, b2);
+      mpz_add (vm1, y, b1);
+      mpz_mul (v1, v1, vm1);
+    }
+
+  mpz_sub (x, x, a1);
+  if (sqr)
+    mpz_mul (vm1, x, x);
+  else
+    {
+      mpz_sub (y, y, b1);
+      mpz_mul (vm1, x, y);
+    }
+
+  mpz_add (x, x, a2);
+  mpz_mul_2exp (x, x, 1);
+  mpz_sub (x, x, a0);
+  if (sqr)
+    mpz_mul (vm2, x, x);
+  else
+    {
+      mpz_add (y, y, b2);
+      mpz_mul_2exp (y, y, 1);
+      mpz_sub (y, y, b0);
+      mpz_mul (vm2, x, y);
+    }
+
+  if (sqr)
+    {
+      mpn_sqr (rp, ap, k);
+      mpn_zero (rp + 2 * k, 2 * k);
+      mpn_sqr (rp + 4 * k, ap + 2 * k, s);
+    }
+  else
+    {
+      mpn_mul_n (rp, ap, bp, k);
+      mpn_zero (rp + 2 * k, 2 * k);
+      mpn_mul_n (rp + 4 * k, ap + 2 * k, bp + 2 * k, s);
+    }
+  mpz_roinit_n (v0, rp, 2 * k);
+  mpz_roinit_n (vinf, rp + 4 * k, 2 * s);
+
+  /* r3 = (r(-2) - r(1)) / 3 */
+  mpz_sub (x, vm2, v1);
+  mpz_divexact_ui (x, x, 3);
+  /* r1 = (r(1) - r(-1)) / 2 */
+  mpz_sub (v1, v1, vm1);
+  mpz_tdiv_q_2exp (v1, v1, 1);
+  /* r2 = r(-1) - r(0) */
+  mpz_sub (vm1, vm1, v0);
+  /* r3 = (r2 - r3) / 2 + 2 r(inf) */
+  mpz_sub (x, vm1, x);
+  mpz_tdiv_q_2exp (x, x, 1);
+  mpz_add (x, x, vinf);
+  mpz_add (x, x, vinf);
+  /* r2 = r2 + r1 - r(inf) */
+  mpz_add (vm1, vm1, v1);
+  mpz_sub (vm1, vm1, vinf);
+  /* r1 = r1 - r3 */
+  mpz_sub (v1, v1, x);
+
+  /* v0 and vinf are views of rp, and no longer needed */
+  mpn_add_mpz_at (rp, 2 * n, k, v1);
+  mpn_add_mpz_at (rp, 2 * n, 2 * k, vm1);
+  mpn_add_mpz_at (rp, 2 * n, 3 * k, x);
+
+  mpz_clear (x);
+  mpz_clear (y);
+  mpz_clear (v1);
+  mpz_clear (vm1);
+  mpz_clear (vm2);
+}
+
+mp_limb_t
+mpn_mul (mp_ptr rp, mp_srcptr up, mp_size_t un, mp_srcptr vp, mp_size_t vn)
+{
+  assert (un >= vn);
+  assert (vn >= 1);
+  assert (!GMP_MPN_OVERLAP_P(rp, un + vn, up, un));
+  assert (!GMP_MPN_OVERLAP_P(rp, un + vn, vp, vn));
+
+  if (vn < MUL_TOOM22_THRESHOLD)
+    mpn_mul_basecase (rp, up, un, vp, vn);
+  else if (un == vn)
+    mpn_mul_n (rp, up, vp, un);
+  else
+    {
+      /* Unbalanced: multiply vn-limb chunks of u by v and add them up. */
+      mp_ptr tp;
+      mp_size_t done;
+
+      tp = gmp_xalloc_limbs (2 * vn);
+      mpn_mul_n (rp, up, vp, vn);
+      for (done = vn; done < un; done += vn)
+	{
+	  mp_size_t cn = GMP_MIN (vn, un - done);
+	  if (cn == vn)
+	    mpn_mul_n (tp, up + done, vp, vn);
+	  else
+	    mpn_mul (tp, vp, vn, up + done, cn);
+	  gmp_assert_nocarry (mpn_add (rp + done, tp, cn + vn, rp + done, vn));
+	}
+      gmp_free (tp);
+    }
+  return rp[un + vn - 1];
 }
 
 void
 mpn_mul_n (mp_ptr rp, mp_srcptr ap, mp_srcptr bp, mp_size_t n)
 {
-  mpn_mul (rp, ap, n, bp, n);
+  mp_ptr tp;
+
+  if (n < MUL_TOOM22_THRESHOLD || n >= MUL_TOOM33_THRESHOLD)
+    {
+      mpn_mul_n_rec (rp, ap, bp, n, NULL);
+      return;
+    }
+
+  tp = gmp_xalloc_limbs (mpn_toom22_mul_itch (n));
+  mpn_toom22_mul (rp, ap, bp, n, tp);
+  gmp_free (tp);
+}
+
+/* Schoolbook squaring: each cross product u_i u_j, i < j, is computed
+   once, the sum is doubled and the diagonal u_i^2 added in. */
+static void
+mpn_sqr_basecase (mp_ptr rp, mp_srcptr up, mp_size_t n)
+{
+  mp_size_t i;
+  mp_limb_t hi, lo, cy;
+
+  if (n == 1)
+    {
+      gmp_umul_ppmm (rp[1], rp[0], up[0], up[0]);
+      return;
+    }
+
+  rp[0] = 0;
+  rp[n] = mpn_mul_1 (rp + 1, up + 1, n - 1, up[0]);
+  for (i = 1; i < n - 1; i++)
+    rp[n + i] = mpn_addmul_1 (rp + 2 * i + 1, up + i + 1, n - i - 1, up[i]);
+  rp[2 * n - 1] = mpn_lshift (rp + 1, rp + 1, 2 * n - 2, 1);
+
+  for (i = 0, cy = 0; i < n; i++)
+    {
+      mp_limb_t r0, r1, c;
+
+      gmp_umul_ppmm (hi, lo, up[i], up[i]);
+      r0 = rp[2 * i] + lo;
+      c = r0 < lo;
+      rp[2 * i] = r0 + cy;
+      c += rp[2 * i] < cy;
+      r1 = rp[2 * i + 1] + hi;
+      cy = r1 < hi;
+      rp[2 * i + 1] = r1 + c;
+      cy += rp[2 * i + 1] < c;
+    }
+  assert (cy == 0);
+}
+
+static mp_size_t
+mpn_toom2_sqr_itch (mp_size_t n)
+{
+  mp_size_t l;
+
+  if (n < SQR_TOOM2_THRESHOLD)
+    return 0;
+  l = n - (n >> 1);
+  return 5 * l + 1 + mpn_toom2_sqr_itch (l);
+}
+
+static void mpn_toom2_sqr (mp_ptr, mp_srcptr, mp_size_t, mp_ptr);
+
+static void
+mpn_sqr_rec (mp_ptr rp, mp_srcptr ap, mp_size_t n, mp_ptr tp)
+{
+  if (n < SQR_TOOM2_THRESHOLD)
+    mpn_sqr_basecase (rp, ap, n);
+  else if (n < SQR_TOOM3_THRESHOLD)
+    mpn_toom2_sqr (rp, ap, n, tp);
+  else
+    mpn_toom33_mul (rp, ap, ap, n);
+}
+
+/* Karatsuba squaring: a^2 = a1^2 B^2l + (a0^2 + a1^2 - (a0 - a1)^2) B^l + a0^2.
+   tp must have mpn_toom2_sqr_itch (n) limbs. */
+static void
+mpn_toom2_sqr (mp_ptr rp, mp_srcptr ap, mp_size_t n, mp_ptr tp)
+{
+  mp_size_t l, h, tn;
+  mp_ptr xp, zp, sp;
+
+  l = n - (n >> 1);
+  h = n >> 1;
+
+  xp = tp;
+  zp = xp + l;
+  sp = zp + 2 * l;
+  tp = sp + 2 * l + 1;
+
+  mpn_absdiff_ext (xp, ap, l, ap + l, h);
+
+  mpn_sqr_rec (rp, ap, l, tp);
+  mpn_sqr_rec (rp + 2 * l, ap + l, h, tp);
+  mpn_sqr_rec (zp, xp, l, tp);
+
+  sp[2 * l] = mpn_add (sp, rp, 2 * l, rp + 2 * l, 2 * h);
+  gmp_assert_nocarry (mpn_sub (sp, sp, 2 * l + 1, zp, 2 * l));
+
+  tn = mpn_normalized_size (sp, 2 * l + 1);
+  assert (tn <= 2 * n - l);
+  if (tn > 0)
+    gmp_assert_nocarry (mpn_add (rp + l, rp + l, 2 * n - l, sp, tn));
 }
 
 void
 mpn_sqr (mp_ptr rp, mp_srcptr ap, mp_size_t n)
 {
-  mpn_mul (rp, ap, n, ap, n);
+  mp_ptr tp;
+
+  assert (n >= 1);
+  assert (!GMP_MPN_OVERLAP_P(rp, 2 * n, ap, n));
+
+  if (n < SQR_TOOM2_THRESHOLD || n >= SQR_TOOM3_THRESHOLD)
+    {
+      mpn_sqr_rec (rp, ap, n, NULL);
+      return;
+    }
+
+  tp = gmp_xalloc_limbs (mpn_toom2_sqr_itch (n));
+  mpn_toom2_sqr (rp, ap, n, tp);
+  gmp_free (tp);
 }
 
 mp_limb_t
@@ -2056,7 +2537,9 @@ mpz_mul (mpz_t r, const mpz_t u, const mpz_t v)
   mpz_init2 (t, (un + vn) * GMP_LIMB_BITS);
 
   tp = t->_mp_d;
-  if (un >= vn)
+  if (u->_mp_d == v->_mp_d && un == vn)
+    mpn_sqr (tp, u->_mp_d, un);
+  else if (un >= vn)
     mpn_mul (tp, u->_mp_d, un, v->_mp_d, vn);
   else
     mpn_mul (tp, v->_mp_d, vn, u->_mp_d, un);
@@ -3041,6 +3524,220 @@ mpz_ui_pow_ui (mpz_t r, unsigned long blimb, unsigned long e)
   mpz_clear (b);
 }
 
+/* Montgomery arithmetic modulo an odd m, with R = B^mn. */
+struct gmp_montgomery
+{
+  mp_srcptr mp;
+  mp_size_t mn;
+  mp_limb_t minv;		/* -1/m mod B */
+  mp_ptr tp;			/* product and multiplication scratch */
+};
+
+static void
+gmp_montgomery_init (struct gmp_montgomery *mont, const mpz_t m)
+{
+  mp_limb_t m0, inv;
+  unsigned bits;
+
+  m0 = m->_mp_d[0];
+  assert (m0 & 1);
+
+  /* Newton iteration, each step doubles the number of correct low bits;
+     an odd m0 is its own inverse mod 8. */
+  for (inv = m0, bits = 3; bits < GMP_LIMB_BITS; bits *= 2)
+    inv *= 2 - m0 * inv;
+
+  mont->mp = m->_mp_d;
+  mont->mn = GMP_ABS (m->_mp_size);
+  mont->minv = -inv;
+  mont->tp = gmp_xalloc_limbs (2 * mont->mn
+			       + GMP_MAX (mpn_toom22_mul_itch (mont->mn),
+					  mpn_toom2_sqr_itch (mont->mn)));
+}
+
+static void
+gmp_montgomery_clear (struct gmp_montgomery *mont)
+{
+  gmp_free (mont->tp);
+}
+
+/* {rp, n} = {up, 2n} / B^n mod m, fully reduced. Clobbers up. The carry
+   out of each step is parked in the limb that step cleared, and all of
+   them are added in at the end. */
+static void
+mpn_redc_1 (mp_ptr rp, mp_ptr up, const struct gmp_montgomery *mont)
+{
+  mp_size_t j, n = mont->mn;
+  mp_limb_t cy;
+
+  for (j = 0; j < n; j++, up++)
+    up[0] = mpn_addmul_1 (up, mont->mp, n, up[0] * mont->minv);
+
+  cy = mpn_add_n (rp, up, up - n, n);
+  if (cy != 0 || mpn_cmp (rp, mont->mp, n) >= 0)
+    mpn_sub_n (rp, rp, mont->mp, n);
+}
+
+/* {rp, n} = {ap, n} {bp, n} / B^n mod m. rp may alias the inputs. */
+static void
+gmp_montgomery_mul (mp_ptr rp, mp_srcptr ap, mp_srcptr bp,
+		    const struct gmp_montgomery *mont)
+{
+  mp_size_t n = mont->mn;
+  mp_ptr tp = mont->tp;
+
+  if (ap == bp)
+    mpn_sqr_rec (tp, ap, n, tp + 2 * n);
+  else
+    mpn_mul_n_rec (tp, ap, bp, n, tp + 2 * n);
+  mpn_redc_1 (rp, tp, mont);
+}
+
+/* {rp, n} = x R mod m */
+static void
+gmp_montgomery_to (mp_ptr rp, const mpz_t x, const mpz_t m,
+		   const struct gmp_montgomery *mont)
+{
+  mpz_t t;
+  mp_size_t tn;
+
+  mpz_init (t);
+  mpz_mul_2exp (t, x, mont->mn * GMP_LIMB_BITS);
+  mpz_mod (t, t, m);
+  tn = t->_mp_size;
+  mpn_copyi (rp, t->_mp_d, tn);
+  mpn_zero (rp + tn, mont->mn - tn);
+  mpz_clear (t);
+}
+
+/* r = x / R mod m, for {xp, n} in Montgomery form */
+static void
+gmp_montgomery_from (mpz_t r, mp_srcptr xp, const struct gmp_montgomery *mont)
+{
+  mp_size_t n = mont->mn;
+  mp_ptr rp = MPZ_REALLOC (r, n);
+
+  mpn_copyi (mont->tp, xp, n);
+  mpn_zero (mont->tp + n, n);
+  mpn_redc_1 (rp, mont->tp, mont);
+  r->_mp_size = mpn_normalized_size (rp, n);
+}
+
+/* Largest window, the table holds 2^(w-1) residues. Lower it where the
+   table must fit in little memory; the default static limb pool of
+   SUMFE_NO_MALLOC builds (sumFE_arena.h) holds the table for w = 4. */
+#ifndef POWM_WINDOW_MAX
+#ifdef SUMFE_NO_MALLOC
+#define POWM_WINDOW_MAX 4
+#else
+#define POWM_WINDOW_MAX 6
+#endif
+#endif
+
+static unsigned
+gmp_powm_window (mp_bitcnt_t ebits)
+{
+  unsigned w;
+
+  if (ebits > 671)
+    w = 6;
+  else if (ebits > 239)
+    w = 5;
+  else if (ebits > 79)
+    w = 4;
+  else if (ebits > 23)
+    w = 3;
+  else
+    w = ebits > 6 ? 2 : 1;
+  return GMP_MIN (w, POWM_WINDOW_MAX);
+}
+
+#define gmp_exp_bit(ep, i) \
+  (((ep)[(i) / GMP_LIMB_BITS] >> ((i) % GMP_LIMB_BITS)) & 1)
+
+/* r = b^{ep, en} mod m for odd m, 0 <= b, en > 0: left-to-right sliding
+   window over a table of the odd powers b, b^3, ..., b^(2^w - 1), all
+   products done in Montgomery form. */
+static void
+mpz_powm_mont (mpz_t r, const mpz_t b, mp_srcptr ep, mp_size_t en,
+	       const mpz_t m)
+{
+  struct gmp_montgomery mont;
+  mp_bitcnt_t ebits;
+  mp_size_t mn, i, tsize;
+  mp_ptr table, rp;
+  unsigned w, k;
+  int first;
+
+  en = mpn_normalized_size (ep, en);
+  assert (en > 0);
+  ebits = en * GMP_LIMB_BITS;
+  {
+    unsigned clz;
+    gmp_clz (clz, ep[en - 1]);
+    ebits -= clz;
+  }
+
+  gmp_montgomery_init (&mont, m);
+  mn = mont.mn;
+
+  w = gmp_powm_window (ebits);
+  tsize = (mp_size_t) 1 << (w - 1);
+  table = gmp_xalloc_limbs ((tsize + 2) * mn);
+  rp = table + tsize * mn;
+
+  /* table[k] = b^(2k+1), using rp + mn for b^2 */
+  gmp_montgomery_to (table, b, m, &mont);
+  if (tsize > 1)
+    {
+      gmp_montgomery_mul (rp + mn, table, table, &mont);
+      for (k = 1; k < tsize; k++)
+	gmp_montgomery_mul (table + k * mn, table + (k - 1) * mn, rp + mn,
+			    &mont);
+    }
+
+  first = 1;
+  i = ebits;
+  while (i-- > 0)
+    {
+      mp_bitcnt_t j;
+      mp_limb_t val;
+
+      if (!gmp_exp_bit (ep, i))
+	{
+	  gmp_montgomery_mul (rp, rp, rp, &mont);
+	  continue;
+	}
+
+      /* Longest window of at most w bits starting at bit i and ending
+	 in a one */
+      j = i + 1 >= w ? i + 1 - w : 0;
+      while (!gmp_exp_bit (ep, j))
+	j++;
+
+      for (val = 0, k = i + 1; k-- > j;)
+	val = (val << 1) | gmp_exp_bit (ep, k);
+
+      if (first)
+	{
+	  mpn_copyi (rp, table + (val >> 1) * mn, mn);
+	  first = 0;
+	}
+      else
+	{
+	  for (k = i + 1; k-- > j;)
+	    gmp_montgomery_mul (rp, rp, rp, &mont);
+	  gmp_montgomery_mul (rp, rp, table + (val >> 1) * mn, &mont);
+	}
+      i = j;
+    }
+
+  gmp_montgomery_from (r, rp, &mont);
+
+  gmp_free (table);
+  gmp_montgomery_clear (&mont);
+}
+
 void
 mpz_powm (mpz_t r, const mpz_t b, const mpz_t e, const mpz_t m)
 {
@@ -3063,6 +3760,25 @@ mpz_powm (mpz_t r, const mpz_t b, const mpz_t e, const mpz_t m)
       return;
     }
 
+  if (m->_mp_d[0] & 1)
+    {
+      mpz_init (base);
+      if (e->_mp_size < 0)
+	{
+	  if (!mpz_invert (base, b, m))
+	    gmp_die ("mpz_powm: Negative exponent and non-invertible base.");
+	}
+      else
+	mpz_mod (base, b, m);
+
+      mpz_init (tr);
+      mpz_powm_mont (tr, base, e->_mp_d, en, m);
+      mpz_swap (r, tr);
+      mpz_clear (tr);
+      mpz_clear (base);
+      return;
+    }
+
   mp = m->_mp_d;
   mpn_div_qr_invert (&minv, mp, mn);
   shift = minv.shift;
@@ -3146,13 +3862,56 @@ mpz_powm (mpz_t r, const mpz_t b, const mpz_t e, const mpz_t m)
   mpz_clear (base);
 }
 
+/* Exponents below 2^POWM_UI_MONT_BITS are too short to pay for the
+   conversions in and out of Montgomery form. */
+#ifndef POWM_UI_MONT_BITS
+#define POWM_UI_MONT_BITS 4
+#endif
+
 void
 mpz_powm_ui (mpz_t r, const mpz_t b, unsigned long elimb, const mpz_t m)
 {
-  mpz_t e;
+  mpz_t e, base, tr;
+  unsigned long bit;
+
+  if (m->_mp_size == 0)
+    gmp_die ("mpz_powm_ui: Zero modulo.");
 
   mpz_init_set_ui (e, elimb);
-  mpz_powm (r, b, e, m);
+  if (!(m->_mp_d[0] & 1) || elimb == 0)
+    {
+      mpz_powm (r, b, e, m);
+      mpz_clear (e);
+      return;
+    }
+
+  mpz_init (base);
+  mpz_init (tr);
+  mpz_mod (base, b, m);
+
+  if (elimb >> POWM_UI_MONT_BITS != 0)
+    mpz_powm_mont (tr, base, e->_mp_d, e->_mp_size, m);
+  else
+    {
+      /* Plain left-to-right binary, reducing after each product */
+      mpz_set (tr, base);
+      for (bit = 1; bit <= elimb / 2; bit <<= 1)
+	;
+      for (bit >>= 1; bit > 0; bit >>= 1)
+	{
+	  mpz_mul (tr, tr, tr);
+	  mpz_mod (tr, tr, m);
+	  if (elimb & bit)
+	    {
+	      mpz_mul (tr, tr, base);
+	      mpz_mod (tr, tr, m);
+	    }
+	}
+    }
+
+  mpz_swap (r, tr);
+  mpz_clear (tr);
+  mpz_clear (base);
   mpz_clear (e);
 }
 
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+#include "sumFE_arena.h"
+
+#ifndef SUMFE_NO_MALLOC
+
+//Every block starts with a header holding its size, so that realloc/free can
+//work without the (unreliable) size arguments passed by mini-gmp
+#define ARENA_ALIGN 16
+#define ARENA_HDR ARENA_ALIGN
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+#define ARENA_NONE ((size_t) -1)
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t top;         //offset of the first free byte
+    size_t last;        //header offset of the most recent block, if still on top
+    size_t peak;
+    int depth;          //number of open epochs
+} Arena;
+
+static _Thread_local Arena arena = { NULL, 0, 0, ARENA_NONE, 0, 0 };
+
+static void arenaDie(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+static int inArena(const void *ptr) {
+    const unsigned char *c = (const unsigned char *) ptr;
+    return arena.base != NULL && c >= arena.base && c < arena.base + arena.size;
+}
+
+static size_t *blockHeader(void *ptr) {
+    return (size_t *) ((unsigned char *) ptr - ARENA_HDR);
+}
+
+int arenaThreadInit(size_t size) {
+    if (arena.base != NULL)
+        return 0;
+    if (size == 0)
+        size = ARENA_DEFAULT_SIZE;
+
+    arena.base = malloc(ARENA_ROUND(size));
+    if (arena.base == NULL)
+        return -1;
+
+    arena.size = ARENA_ROUND(size);
+    arena.top = 0;
+    arena.last = ARENA_NONE;
+    arena.peak = 0;
+    arena.depth = 0;
+    return 0;
+}
+
+void arenaThreadFree(void) {
+    free(arena.base);
+    arena.base = NULL;
+    arena.size = 0;
+    arena.top = 0;
+    arena.last = ARENA_NONE;
+    arena.depth = 0;
+}
+
+size_t arenaEpochBegin(void) {
+    arena.depth++;
+    return arena.top;
+}
+
+void arenaEpochEnd(size_t mark) {
+    if (arena.depth > 0)
+        arena.depth--;
+    arena.top = mark;
+    arena.last = ARENA_NONE;
+}
+
+//Raw allocation from the calling thread's arena, NULL when the thread has no
+//arena or it is exhausted
+static void *arenaAlloc(size_t size) {
+    size_t need = ARENA_HDR + ARENA_ROUND(size);
+
+    if (arena.base == NULL || need > arena.size - arena.top)
+        return NULL;
+
+    size_t *hdr = (size_t *) (arena.base + arena.top);
+    *hdr = size;
+
+    arena.last = arena.top;
+    arena.top += need;
+    if (arena.top > arena.peak)
+        arena.peak = arena.top;
+
+    return arena.base + arena.last + ARENA_HDR;
+}
+
+size_t arenaPeak(void) {
+    return arena.peak;
+}
+
+static void *arenaGmpAlloc(size_t size) {
+    void *ptr = NULL;
+
+    if (arena.depth > 0)
+        ptr = arenaAlloc(size);
+
+    //No epoch open, or the arena is exhausted: use the heap
+    if (ptr == NULL) {
+        ptr = malloc(size);
+        if (ptr == NULL)
+            arenaDie("arenaGmpAlloc: Virtual memory exhausted.");
+    }
+    return ptr;
+}
+
+static void arenaGmpFree(void *ptr, size_t size) {
+    (void) size;
+
+    if (!inArena(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    //Only the block on top can be given back before the epoch ends
+    size_t off = (size_t) ((unsigned char *) ptr - arena.base) - ARENA_HDR;
+    if (off == arena.last) {
+        arena.top = off;
+        arena.last = ARENA_NONE;
+    }
+}
+
+static void *arenaGmpRealloc(void *old, size_t old_size_arg, size_t new_size) {
+    (void) old_size_arg;
+
+    //Heap blocks stay on the heap, so objects created before an epoch survive it
+    if (!inArena(old)) {
+        void *ptr = realloc(old, new_size);
+        if (ptr == NULL)
+            arenaDie("arenaGmpRealloc: Virtual memory exhausted.");
+        return ptr;
+    }
+
+    size_t *hdr = blockHeader(old);
+    size_t old_size = *hdr;
+    size_t off = (size_t) ((unsigned char *) hdr - arena.base);
+
+    //Grow (or shrink) the top block in place when there is room
+    if (off == arena.last && ARENA_HDR + ARENA_ROUND(new_size) <= arena.size - off) {
+        *hdr = new_size;
+        arena.top = off + ARENA_HDR + ARENA_ROUND(new_size);
+        if (arena.top > arena.peak)
+            arena.peak = arena.top;
+        return old;
+    }
+
+    if (new_size <= old_size)
+        return old;
+
+    void *ptr = arenaGmpAlloc(new_size);
+    memcpy(ptr, old, old_size);
+    arenaGmpFree(old, 0);
+    return ptr;
+}
+
+#else
+
+//No heap: fixed-size slots in static storage, in two size classes. A block
+//keeps its slot until it is freed, so there is nothing to fragment, and
+//growing a block within its slot costs nothing.
+#define ARENA_STR_(x) #x
+#define ARENA_STR(x) ARENA_STR_(x)
+#pragma message("SUMFE_NO_MALLOC: limb pool of " ARENA_STR(ARENA_POOL_SLOTS) " x " ARENA_STR(ARENA_POOL_SLOT_SIZE) " + " ARENA_STR(ARENA_POOL_LARGE_SLOTS) " x " ARENA_STR(ARENA_POOL_LARGE_SLOT_SIZE) " bytes")
+
+typedef struct {
+    unsigned char *base;
+    size_t slotSize;
+    int count;
+    int avail;
+    int *free;          //stack of free slot indices
+} SlotClass;
+
+static _Alignas(16) unsigned char poolSmall[ARENA_POOL_SLOTS][ARENA_POOL_SLOT_SIZE];
+static _Alignas(16) unsigned char poolLarge[ARENA_POOL_LARGE_SLOTS][ARENA_POOL_LARGE_SLOT_SIZE];
+static int freeSmall[ARENA_POOL_SLOTS];
+static int freeLarge[ARENA_POOL_LARGE_SLOTS];
+
+static SlotClass pool[2] = {
+    { &poolSmall[0][0], ARENA_POOL_SLOT_SIZE, ARENA_POOL_SLOTS, 0, freeSmall },
+    { &poolLarge[0][0], ARENA_POOL_LARGE_SLOT_SIZE, ARENA_POOL_LARGE_SLOTS, 0, freeLarge },
+};
+static size_t poolInUse, poolPeak;
+
+static void arenaDie(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    abort();
+}
+
+static SlotClass *slotClass(const void *ptr) {
+    const unsigned char *c = (const unsigned char *) ptr;
+
+    for (int k = 0; k < 2; k++) {
+        if (c >= pool[k].base && c < pool[k].base + pool[k].count * pool[k].slotSize)
+            return &pool[k];
+    }
+    return NULL;
+}
+
+int arenaThreadInit(size_t size) {
+    (void) size;
+    return 0;
+}
+
+void arenaThreadFree(void) {
+}
+
+size_t arenaEpochBegin(void) {
+    return 0;
+}
+
+void arenaEpochEnd(size_t mark) {
+    (void) mark;
+}
+
+size_t arenaPeak(void) {
+    return poolPeak;
+}
+
+static void *arenaGmpAlloc(size_t size) {
+    //Small requests spill into the large class when their own runs out
+    for (int k = 0; k < 2; k++) {
+        SlotClass *c = &pool[k];
+        if (size > c->slotSize || c->avail == 0)
+            continue;
+
+        poolInUse += c->slotSize;
+        if (poolInUse > poolPeak)
+            poolPeak = poolInUse;
+        return c->base + (size_t) c->free[--c->avail] * c->slotSize;
+    }
+    arenaDie("arenaGmpAlloc: Limb pool exhausted, raise ARENA_POOL_*.");
+    return NULL;
+}
+
+static void arenaGmpFree(void *ptr, size_t size) {
+    (void) size;
+
+    SlotClass *c = slotClass(ptr);
+
+    if (c == NULL)
+        arenaDie("arenaGmpFree: Block is not from the limb pool.");
+
+    c->free[c->avail++] = (int) (((unsigned char *) ptr - c->base) / c->slotSize);
+    poolInUse -= c->slotSize;
+}
+
+static void *arenaGmpRealloc(void *old, size_t old_size, size_t new_size) {
+    (void) old_size;
+
+    SlotClass *c = slotClass(old);
+
+    if (c == NULL)
+        arenaDie("arenaGmpRealloc: Block is not from the limb pool.");
+    if (new_size <= c->slotSize)
+        return old;
+
+    void *ptr = arenaGmpAlloc(new_size);
+    memcpy(ptr, old, c->slotSize);
+    arenaGmpFree(old, 0);
+    return ptr;
+}
+
+#endif
+
+void arenaInstall(void) {
+#ifdef SUMFE_NO_MALLOC
+    for (int k = 0; k < 2; k++) {
+        for (pool[k].avail = 0; pool[k].avail < pool[k].count; pool[k].avail++)
+            pool[k].free[pool[k].avail] = pool[k].count - 1 - pool[k].avail;
+    }
+    poolInUse = poolPeak = 0;
+#endif
+    mp_set_memory_functions(arenaGmpAlloc, arenaGmpRealloc, arenaGmpFree);
+}
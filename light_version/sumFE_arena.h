@@ -0,0 +1,62 @@
+#ifndef SUMFE_ARENA_H
+#define SUMFE_ARENA_H
+
+#include <stddef.h>
+
+//Per-thread bump allocator for big-integer temporaries.
+//
+//Once arenaInstall() has hooked it into mp_set_memory_functions, every limb
+//allocation made on a thread inside an epoch (arenaEpochBegin/arenaEpochEnd)
+//is carved out of that thread's arena and released in one go when the epoch
+//ends. Outside an epoch, and on threads without an arena, requests fall
+//through to malloc/realloc/free.
+//
+//Rules for callers:
+//  - anything that must outlive the epoch has to be allocated before it
+//    begins (e.g. mpz_init2 the output to the size of p). Blocks that already
+//    live on the heap stay on the heap when they are grown inside an epoch.
+//  - temporaries created inside an epoch must not be used after it ends, nor
+//    handed to another thread.
+
+//Default arena size per thread, can be overridden at compile time
+#ifndef ARENA_DEFAULT_SIZE
+#define ARENA_DEFAULT_SIZE (1 << 20)
+#endif
+
+//Build with -DSUMFE_NO_MALLOC for clients without a usable heap. The hooks
+//then hand out fixed-size slots from static storage and abort when the pool
+//runs dry, never calling malloc. Every slot goes back when its mpz is
+//cleared, so epochs are no-ops; arenaPeak reports the pool high-water mark.
+//The pool is process wide and not thread safe. The defaults fit
+//genKeyPair/HE_Encrypt with a 1024-bit p and mini-gmp's powm window of at
+//most 4 bits (its default under SUMFE_NO_MALLOC); the size is printed when
+//sumFE_arena.c is compiled.
+#ifndef ARENA_POOL_SLOT_SIZE
+#define ARENA_POOL_SLOT_SIZE 288        //a 2048-bit product and the division's spare limbs
+#endif
+#ifndef ARENA_POOL_SLOTS
+#define ARENA_POOL_SLOTS 16
+#endif
+#ifndef ARENA_POOL_LARGE_SLOT_SIZE
+#define ARENA_POOL_LARGE_SLOT_SIZE 1280 //powm window table and multiplication scratch
+#endif
+#ifndef ARENA_POOL_LARGE_SLOTS
+#define ARENA_POOL_LARGE_SLOTS 2
+#endif
+
+//Route the GMP/mini-gmp allocations through the arena hooks (process wide)
+void arenaInstall(void);
+
+//Reserve/release the calling thread's arena (size 0 selects ARENA_DEFAULT_SIZE)
+int arenaThreadInit(size_t size);
+void arenaThreadFree(void);
+
+//Open an epoch and return its mark; closing it resets the arena to the mark.
+//Epochs may be nested as long as they are closed in reverse order.
+size_t arenaEpochBegin(void);
+void arenaEpochEnd(size_t mark);
+
+//High-water mark of the calling thread's arena, in bytes
+size_t arenaPeak(void);
+
+#endif
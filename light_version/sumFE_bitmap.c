@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumFE_bitmap.h"
+
+#define CHUNK_WORDS (BITMAP_CHUNK_SIZE / 64)
+
+void bitmapInit(Bitmap *b) {
+    b->chunks = NULL;
+    b->num = 0;
+    b->cap = 0;
+}
+
+void bitmapFree(Bitmap *b) {
+    for (size_t i = 0; i < b->num; i++) {
+        free(b->chunks[i].array);
+        free(b->chunks[i].bits);
+    }
+    free(b->chunks);
+    bitmapInit(b);
+}
+
+//Index of the chunk with the given key, or where it would be inserted
+static size_t findChunk(const Bitmap *b, uint16_t key) {
+    size_t lo = 0, hi = b->num;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (b->chunks[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static BitmapChunk *getChunk(Bitmap *b, uint16_t key) {
+    size_t i = findChunk(b, key);
+
+    if (i < b->num && b->chunks[i].key == key)
+        return &b->chunks[i];
+
+    if (b->num == b->cap) {
+        size_t cap = b->cap ? 2 * b->cap : 4;
+        BitmapChunk *c = realloc(b->chunks, cap * sizeof(BitmapChunk));
+        if (c == NULL)
+            return NULL;
+        b->chunks = c;
+        b->cap = cap;
+    }
+
+    memmove(&b->chunks[i + 1], &b->chunks[i], (b->num - i) * sizeof(BitmapChunk));
+    memset(&b->chunks[i], 0, sizeof(BitmapChunk));
+    b->chunks[i].key = key;
+    b->num++;
+    return &b->chunks[i];
+}
+
+//Position of low in the chunk's array, or where it would be inserted
+static uint32_t findLow(const BitmapChunk *c, uint16_t low) {
+    uint32_t lo = 0, hi = c->card;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (c->array[mid] < low)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int toBits(BitmapChunk *c) {
+    uint64_t *bits = calloc(CHUNK_WORDS, sizeof(uint64_t));
+    if (bits == NULL)
+        return -1;
+
+    for (uint32_t i = 0; i < c->card; i++)
+        bits[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+
+    free(c->array);
+    c->array = NULL;
+    c->cap = 0;
+    c->bits = bits;
+    return 0;
+}
+
+int bitmapAdd(Bitmap *b, uint32_t x) {
+    BitmapChunk *c = getChunk(b, (uint16_t) (x >> BITMAP_CHUNK_BITS));
+    uint16_t low = (uint16_t) x;
+
+    if (c == NULL)
+        return -1;
+
+    if (c->bits == NULL) {
+        uint32_t pos = findLow(c, low);
+        if (pos < c->card && c->array[pos] == low)
+            return 0;
+
+        if (c->card < BITMAP_ARRAY_MAX) {
+            if (c->card == c->cap) {
+                uint32_t cap = c->cap ? 2 * c->cap : 4;
+                uint16_t *a = realloc(c->array, cap * sizeof(uint16_t));
+                if (a == NULL)
+                    return -1;
+                c->array = a;
+                c->cap = cap;
+            }
+            memmove(&c->array[pos + 1], &c->array[pos], (c->card - pos) * sizeof(uint16_t));
+            c->array[pos] = low;
+            c->card++;
+            return 0;
+        }
+
+        if (toBits(c) != 0)
+            return -1;
+    }
+
+    uint64_t bit = 1ULL << (low & 63);
+    if (!(c->bits[low >> 6] & bit)) {
+        c->bits[low >> 6] |= bit;
+        c->card++;
+    }
+    return 0;
+}
+
+int bitmapAddRange(Bitmap *b, uint32_t begin, uint32_t end) {
+    while (begin < end) {
+        uint32_t key = begin >> BITMAP_CHUNK_BITS;
+        uint64_t chunkEnd = ((uint64_t) key + 1) << BITMAP_CHUNK_BITS;
+        uint32_t stop = chunkEnd < end ? (uint32_t) chunkEnd : end;
+
+        BitmapChunk *c = getChunk(b, (uint16_t) key);
+        if (c == NULL)
+            return -1;
+
+        //Ranges too long for an array go straight into the bitmap
+        if (c->bits == NULL && c->card + (stop - begin) > BITMAP_ARRAY_MAX && toBits(c) != 0)
+            return -1;
+
+        if (c->bits != NULL) {
+            for (uint32_t x = begin; x < stop; x++) {
+                uint16_t low = (uint16_t) x;
+                uint64_t bit = 1ULL << (low & 63);
+                c->card += !(c->bits[low >> 6] & bit);
+                c->bits[low >> 6] |= bit;
+            }
+        } else {
+            for (uint32_t x = begin; x < stop; x++) {
+                if (bitmapAdd(b, x) != 0)
+                    return -1;
+            }
+        }
+        begin = stop;
+    }
+    return 0;
+}
+
+int bitmapRemove(Bitmap *b, uint32_t x) {
+    size_t i = findChunk(b, (uint16_t) (x >> BITMAP_CHUNK_BITS));
+    uint16_t low = (uint16_t) x;
+
+    if (i == b->num || b->chunks[i].key != (uint16_t) (x >> BITMAP_CHUNK_BITS))
+        return 0;
+
+    //Chunks are not converted back to arrays, a later add may refill them
+    BitmapChunk *c = &b->chunks[i];
+    if (c->bits != NULL) {
+        uint64_t bit = 1ULL << (low & 63);
+        if (c->bits[low >> 6] & bit) {
+            c->bits[low >> 6] &= ~bit;
+            c->card--;
+        }
+    } else {
+        uint32_t pos = findLow(c, low);
+        if (pos < c->card && c->array[pos] == low) {
+            memmove(&c->array[pos], &c->array[pos + 1], (c->card - pos - 1) * sizeof(uint16_t));
+            c->card--;
+        }
+    }
+    return 0;
+}
+
+const BitmapChunk *bitmapFind(const Bitmap *b, uint16_t key) {
+    size_t i = findChunk(b, key);
+    return i < b->num && b->chunks[i].key == key && b->chunks[i].card > 0 ? &b->chunks[i] : NULL;
+}
+
+int bitmapContains(const Bitmap *b, uint32_t x) {
+    const BitmapChunk *c = bitmapFind(b, (uint16_t) (x >> BITMAP_CHUNK_BITS));
+    uint16_t low = (uint16_t) x;
+
+    if (c == NULL)
+        return 0;
+    if (c->bits != NULL)
+        return (c->bits[low >> 6] >> (low & 63)) & 1;
+
+    uint32_t pos = findLow(c, low);
+    return pos < c->card && c->array[pos] == low;
+}
+
+uint64_t bitmapCount(const Bitmap *b) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < b->num; i++)
+        n += b->chunks[i].card;
+    return n;
+}
+
+size_t bitmapChunkList(const BitmapChunk *c, int missing, uint32_t limit, uint16_t *out) {
+    size_t n = 0;
+
+    if (limit > BITMAP_CHUNK_SIZE)
+        limit = BITMAP_CHUNK_SIZE;
+
+    if (c == NULL) {
+        for (uint32_t x = 0; missing && x < limit; x++)
+            out[n++] = (uint16_t) x;
+        return n;
+    }
+
+    if (c->bits != NULL) {
+        //One word at a time, skipping over runs of the other kind
+        for (uint32_t w = 0; w < CHUNK_WORDS && 64 * w < limit; w++) {
+            uint64_t word = missing ? ~c->bits[w] : c->bits[w];
+            if (64 * w + 64 > limit)
+                word &= (1ULL << (limit - 64 * w)) - 1;
+            while (word != 0) {
+                out[n++] = (uint16_t) (64 * w + (uint32_t) __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+        return n;
+    }
+
+    if (!missing) {
+        while (n < c->card && c->array[n] < limit) {
+            out[n] = c->array[n];
+            n++;
+        }
+        return n;
+    }
+
+    //Gaps between the sorted values
+    uint32_t x = 0;
+    for (uint32_t i = 0; i <= c->card; i++) {
+        uint32_t next = i < c->card ? c->array[i] : limit;
+        if (next > limit)
+            next = limit;
+        for (; x < next; x++)
+            out[n++] = (uint16_t) x;
+        x = next + 1;
+        if (x >= limit)
+            break;
+    }
+    return n;
+}
@@ -0,0 +1,52 @@
+#ifndef SUMFE_BITMAP_H
+#define SUMFE_BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Compressed set of user slots (roaring style), e.g. the users that submitted
+//in an epoch.
+//
+//Slots are split into chunks of 2^16 by their high half. A chunk stores the
+//low halves as a sorted array while it holds at most BITMAP_ARRAY_MAX of
+//them and as a 65536-bit bitmap (8 KB) once it holds more, so both sparse
+//and nearly full participation stay small and fast to walk.
+
+#define BITMAP_CHUNK_BITS 16
+#define BITMAP_CHUNK_SIZE (1u << BITMAP_CHUNK_BITS)
+#define BITMAP_ARRAY_MAX 4096
+
+typedef struct {
+    uint16_t key;               //high half of the slots
+    uint32_t card;
+    uint32_t cap;               //allocated entries of array
+    uint16_t *array;            //sorted low halves, or NULL once bits is used
+    uint64_t *bits;
+} BitmapChunk;
+
+typedef struct {
+    BitmapChunk *chunks;        //sorted by key
+    size_t num;
+    size_t cap;
+} Bitmap;
+
+void bitmapInit(Bitmap *b);
+void bitmapFree(Bitmap *b);
+
+//All return 0 on success and -1 if memory ran out
+int bitmapAdd(Bitmap *b, uint32_t x);
+int bitmapAddRange(Bitmap *b, uint32_t begin, uint32_t end);
+int bitmapRemove(Bitmap *b, uint32_t x);
+
+int bitmapContains(const Bitmap *b, uint32_t x);
+uint64_t bitmapCount(const Bitmap *b);
+
+//Chunk holding the slots with the given high half, NULL if it is empty
+const BitmapChunk *bitmapFind(const Bitmap *b, uint16_t key);
+
+//Low halves of the slots in c (or, with missing set, of those below limit
+//that are not in c), in increasing order; returns how many were written.
+//c may be NULL for an empty chunk. out needs room for BITMAP_CHUNK_SIZE values.
+size_t bitmapChunkList(const BitmapChunk *c, int missing, uint32_t limit, uint16_t *out);
+
+#endif
@@ -0,0 +1,121 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "sumFE_dlog.h"
+
+//Low 64 bits of x, whatever the limb size
+static uint64_t lowBits(const mpz_t x) {
+    const unsigned limbBits = CHAR_BIT * sizeof(mp_limb_t);
+    uint64_t k = 0;
+
+    for (size_t i = 0; i * limbBits < 64 && i < mpz_size(x); i++)
+        k |= (uint64_t) mpz_getlimbn(x, i) << (i * limbBits);
+    return k;
+}
+
+static int cmpEntry(const void *a, const void *b) {
+    const DlogEntry *x = a, *y = b;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->exp < y->exp ? -1 : x->exp > y->exp;
+}
+
+int dlogInit(DlogTable *t, const mpz_t g, const mpz_t p, size_t size) {
+    t->size = size;
+    t->entries = malloc((size ? size : 1) * sizeof(DlogEntry));
+    mpz_init_set(t->g, g);
+    mpz_init_set(t->p, p);
+    if (t->entries == NULL || size > UINT32_MAX) {
+        dlogClear(t);
+        return -1;
+    }
+
+    //Consecutive powers: one modular multiplication per entry
+    mpz_t x;
+    mpz_init_set_ui(x, 1);
+    for (size_t i = 0; i < size; i++) {
+        t->entries[i].key = lowBits(x);
+        t->entries[i].exp = (uint32_t) i;
+        mpz_mul(x, x, g);
+        mpz_mod(x, x, p);
+    }
+    mpz_clear(x);
+
+    qsort(t->entries, size, sizeof(DlogEntry), cmpEntry);
+    return 0;
+}
+
+void dlogClear(DlogTable *t) {
+    free(t->entries);
+    t->entries = NULL;
+    t->size = 0;
+    mpz_clear(t->g);
+    mpz_clear(t->p);
+}
+
+//First entry at or after lo whose key is not below k: gallop from lo, then
+//binary search the last step
+static size_t lowerBound(const DlogTable *t, size_t lo, uint64_t k) {
+    size_t step = 1, hi = lo;
+
+    while (hi < t->size && t->entries[hi].key < k) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > t->size)
+        hi = t->size;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->entries[mid].key < k)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+typedef struct {
+    uint64_t key;
+    size_t i;
+} DlogQuery;
+
+static int cmpQuery(const void *a, const void *b) {
+    const DlogQuery *x = a, *y = b;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+int dlogSolve(const DlogTable *t, const mpz_srcptr *values, size_t num, long *out) {
+    DlogQuery *q = malloc((num ? num : 1) * sizeof(DlogQuery));
+    if (q == NULL)
+        return -1;
+
+    for (size_t i = 0; i < num; i++) {
+        q[i].key = lowBits(values[i]);
+        q[i].i = i;
+        out[i] = -1;
+    }
+    qsort(q, num, sizeof(DlogQuery), cmpQuery);
+
+    mpz_t x;
+    mpz_init(x);
+
+    size_t pos = 0;
+    for (size_t j = 0; j < num; j++) {
+        pos = lowerBound(t, pos, q[j].key);
+
+        //Equal low bits are almost surely the value itself, but check
+        for (size_t e = pos; e < t->size && t->entries[e].key == q[j].key; e++) {
+            mpz_powm_ui(x, t->g, t->entries[e].exp, t->p);
+            if (mpz_cmp(x, values[q[j].i]) == 0) {
+                out[q[j].i] = (long) t->entries[e].exp;
+                break;
+            }
+        }
+    }
+
+    mpz_clear(x);
+    free(q);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef SUMFE_DLOG_H
+#define SUMFE_DLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Discrete logs of small exponents: m in [0, size) from g^m mod p.
+//
+//The table holds the low 64 bits of every g^m with m, sorted by those bits
+//(16 bytes an entry instead of a full residue). dlogSolve looks up a batch of
+//values at once: they are sorted the same way and found in one ascending
+//pass over the table, each search starting where the previous one ended, so
+//a vector of sums costs about one walk through the table rather than one
+//search per value. A match is confirmed with g^m before it is returned.
+
+typedef struct {
+    uint64_t key;               //low 64 bits of g^exp mod p
+    uint32_t exp;
+} DlogEntry;
+
+typedef struct {
+    DlogEntry *entries;         //sorted by key
+    size_t size;
+    mpz_t g;
+    mpz_t p;
+} DlogTable;
+
+//Build the table for exponents 0 .. size-1. Returns -1 if out of memory.
+int dlogInit(DlogTable *t, const mpz_t g, const mpz_t p, size_t size);
+void dlogClear(DlogTable *t);
+
+//out[i] = m with g^m = values[i] mod p, or -1 if m is not below t->size.
+//Returns -1 if out of memory, 0 otherwise.
+int dlogSolve(const DlogTable *t, const mpz_srcptr *values, size_t num, long *out);
+
+#endif
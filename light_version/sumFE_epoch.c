@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "sumFE_epoch.h"
+
+int epochSeedLoad(const char *path, unsigned char seed[RNG_SEED_SIZE]) {
+    FILE *fp = fopen(path, "rb");
+
+    if (fp != NULL) {
+        size_t n = fread(seed, 1, RNG_SEED_SIZE, fp);
+        fclose(fp);
+        return n == RNG_SEED_SIZE ? 0 : -1;
+    }
+
+    //First party to run: create the seed for everyone else
+    if (rngSystemSeed(seed) != 0)
+        return -1;
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    int ret = fwrite(seed, 1, RNG_SEED_SIZE, fp) == RNG_SEED_SIZE ? 0 : -1;
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+int epochDeriveR(mpz_t r, const unsigned char seed[RNG_SEED_SIZE], uint64_t id, const mpz_t p) {
+    RngStream rng;
+    mpz_t range;
+
+    // r = 1 + uniform [0, p-2)
+    mpz_init_set(range, p);
+    mpz_sub_ui(range, range, 2);
+
+    rngInit(&rng, seed, id);
+    int ret = rngUniformMod(&rng, r, range);
+    mpz_add_ui(r, r, 1);
+
+    rngClear(&rng);
+    mpz_clear(range);
+    return ret;
+}
+
+int epochInit(EpochContext *ep, uint64_t id, const unsigned char seed[RNG_SEED_SIZE], const mpz_t g, const mpz_t p) {
+    ep->id = id;
+    mpz_init(ep->r);
+    mpz_init(ep->firstcomp);
+    if (epochDeriveR(ep->r, seed, id, p) != 0)
+        return -1;
+
+    // (gˆr) % p
+    mpz_powm(ep->firstcomp, g, ep->r, p);
+    return 0;
+}
+
+void epochInitShared(EpochContext *ep, uint64_t id, const mpz_t r, const mpz_t firstcomp) {
+    ep->id = id;
+    mpz_init_set(ep->r, r);
+    mpz_init_set(ep->firstcomp, firstcomp);
+}
+
+void epochClear(EpochContext *ep) {
+    mpz_clear(ep->r);
+    mpz_clear(ep->firstcomp);
+}
+
+void epochCiphertextHeader(uint64_t id, SfeHeader *h, uint64_t fingerprint, int compact) {
+    sfeInitHeader(h, SFE_KIND_CIPHERTEXT, compact ? 1 : 2, fingerprint, id);
+    if (compact)
+        h->flags |= SFE_FLAG_COMPACT;
+}
+
+int epochCheckHeader(const SfeHeader *h, uint64_t fingerprint) {
+    int compact = (h->flags & SFE_FLAG_COMPACT) != 0;
+
+    if (h->kind != SFE_KIND_CIPHERTEXT || h->fingerprint != fingerprint)
+        return -1;
+    return h->fields == (compact ? 1u : 2u) ? 0 : -1;
+}
+
+int epochWriteCiphertext(FILE *fp, const SfeHeader *h, uint32_t user, const mpz_t first, const mpz_t second) {
+    return epochWriteCiphertextAt(fp, h, user, 0, first, second);
+}
+
+int epochWriteCiphertextAt(FILE *fp, const SfeHeader *h, uint32_t user, uint32_t epochOffset, const mpz_t first, const mpz_t second) {
+    if (sfeWriteId(fp, user, epochOffset) != 0)
+        return -1;
+    if (!(h->flags & SFE_FLAG_COMPACT) && sfeWriteField(fp, h, first) != 0)
+        return -1;
+    return sfeWriteField(fp, h, second);
+}
+
+int epochReadCiphertext(FILE *fp, const SfeHeader *h, const EpochContext *ep, uint32_t *user, mpz_t first, mpz_t second) {
+    uint32_t offset;
+    int compact = (h->flags & SFE_FLAG_COMPACT) != 0;
+
+    if (epochCheckHeader(h, h->fingerprint) != 0)
+        return -1;
+    if (sfeReadId(fp, user, &offset) != 0)
+        return -1;
+
+    if (compact) {
+        //The shared component is only known for the context's own epoch
+        if (ep == NULL || h->epoch + offset != ep->id)
+            return -1;
+        mpz_set(first, ep->firstcomp);
+    } else if (sfeReadField(fp, h, first) != 0) {
+        return -1;
+    }
+    return sfeReadField(fp, h, second);
+}
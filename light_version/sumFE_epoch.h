@@ -0,0 +1,72 @@
+#ifndef SUMFE_EPOCH_H
+#define SUMFE_EPOCH_H
+
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+#include "sumFE_io.h"
+#include "sumFE_rng.h"
+
+//Per-epoch context of the clients.
+//
+//All users encrypt an epoch with the same randomness r, so the first
+//ciphertext component g^r mod p is identical for all of them.
+//
+//r is drawn afresh for every epoch, uniform in [1, p-1), from the ChaCha20
+//substream numbered by the epoch id of a seed shared by the clients (the
+//epoch seed, kept in EPOCH_SEED_FILE). Every client derives the same r for
+//an epoch without further coordination. Whoever knows r can take pk^r out of
+//a single user's ciphertext, so the seed stays with the clients: aggregators
+//and the decryptor only see g^r, which every ciphertext carries as its
+//firstcomp. Compact ciphertexts (SFE_FLAG_COMPACT) leave it out and can only
+//be read back with the context of their epoch.
+//
+//Aggregates of different epochs therefore do not share g^r. Their product has
+//the product of the epochs' g^r as firstcomp and decrypts with msk as long as
+//the epochs have the same users (the rolling window); the range store, whose
+//epochs have different users, keeps each epoch's mask g^(r * msk) instead.
+#define EPOCH_SEED_FILE "epochseed.bin"
+
+typedef struct {
+    uint64_t id;
+    mpz_t r;
+    mpz_t firstcomp;
+} EpochContext;
+
+//Read the epoch seed from path, creating it from the system generator if
+//the file does not exist yet. Returns 0 on success, -1 on failure.
+int epochSeedLoad(const char *path, unsigned char seed[RNG_SEED_SIZE]);
+
+//r of epoch id; 0 on success, -1 if memory ran out
+int epochDeriveR(mpz_t r, const unsigned char seed[RNG_SEED_SIZE], uint64_t id, const mpz_t p);
+
+//Context of epoch id, r derived from the seed. Returns 0 on success.
+int epochInit(EpochContext *ep, uint64_t id, const unsigned char seed[RNG_SEED_SIZE], const mpz_t g, const mpz_t p);
+
+//Same, with r and g^r mod p already computed by the caller (e.g. g^r from a
+//fixed-base table)
+void epochInitShared(EpochContext *ep, uint64_t id, const mpz_t r, const mpz_t firstcomp);
+void epochClear(EpochContext *ep);
+
+//Ciphertext header for epoch id, compact or with both components
+void epochCiphertextHeader(uint64_t id, SfeHeader *h, uint64_t fingerprint, int compact);
+
+//0 if h describes ciphertexts under these parameters: SFE_KIND_CIPHERTEXT with
+//one field when compact and two otherwise, -1 if not
+int epochCheckHeader(const SfeHeader *h, uint64_t fingerprint);
+
+//Write/read one ciphertext record. Compact records must belong to the epoch
+//of ep (NULL rejects them), their firstcomp is filled in from the context.
+//Return 0 on success.
+int epochWriteCiphertext(FILE *fp, const SfeHeader *h, uint32_t user, const mpz_t first, const mpz_t second);
+
+//Same, for a record of epoch h->epoch + epochOffset (batches spanning epochs)
+int epochWriteCiphertextAt(FILE *fp, const SfeHeader *h, uint32_t user, uint32_t epochOffset, const mpz_t first, const mpz_t second);
+int epochReadCiphertext(FILE *fp, const SfeHeader *h, const EpochContext *ep, uint32_t *user, mpz_t first, mpz_t second);
+
+#endif
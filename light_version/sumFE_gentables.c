@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include "mini-gmp.h"
+
+//Emits the parameter set of the light client as constant limb arrays, so a
+//device build can keep them in rodata/flash instead of parsing decimal
+//strings and computing g^r from scratch at every boot:
+//
+//  sumFE_gentables [-w bits] [-e exponent_bits] [-l limb_bits] sumFE_params.h
+//
+//  -w   fixed-base window width (default 4)
+//  -e   widest exponent the g table has to cover (default: unsigned long)
+//  -l   limb size of the target (default: this host's)
+//
+//The header is meant for sumFE_light.c built with -DSUMFE_CONST_PARAMS.
+
+static void emitLimbs(FILE *out, const mpz_t x, int n, int limbBits) {
+    mpz_t t, w;
+    mpz_init(t);
+    mpz_init(w);
+
+    for (int i = 0; i < n; i++) {
+        mpz_tdiv_q_2exp(t, x, (mp_bitcnt_t) i * limbBits);
+        mpz_tdiv_r_2exp(w, t, limbBits);
+        fprintf(out, "%s0x%0*lx", i % 4 == 0 ? "\n    " : " ", limbBits / 4, mpz_get_ui(w));
+        if (i + 1 < n)
+            fputc(',', out);
+    }
+
+    mpz_clear(t);
+    mpz_clear(w);
+}
+
+static void emitArray(FILE *out, const char *name, const mpz_t x, int n, int limbBits) {
+    fprintf(out, "static const mp_limb_t %s[SFE_PARAM_LIMBS] = {", name);
+    emitLimbs(out, x, n, limbBits);
+    fprintf(out, "\n};\n\n");
+}
+
+int main(int argc, char **argv) {
+    mpz_t p, g, q;
+    int bits = 4;
+    int expBits = (int) (sizeof(unsigned long int) * CHAR_BIT);
+    int limbBits = (int) (sizeof(mp_limb_t) * CHAR_BIT);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:e:l:")) != -1) {
+        switch (opt) {
+        case 'w': bits = atoi(optarg); break;
+        case 'e': expBits = atoi(optarg); break;
+        case 'l': limbBits = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-w bits] [-e exponent_bits] [-l limb_bits] out.h\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || bits < 1 || bits > 16 || expBits < 1
+        || (limbBits != 32 && limbBits != 64) || limbBits > (int) (sizeof(unsigned long int) * CHAR_BIT)) {
+        fprintf(stderr, "usage: %s [-w bits] [-e exponent_bits] [-l limb_bits] out.h\n", argv[0]);
+        return 1;
+    }
+
+    mpz_init_set_str(p, "141103728801468755249503291901801300339454489134873273269161807133184957725631203791969744406992490029017308434294093310271973777802513443575042969796895750747614660497411432558300476234836462151925376765365205539666438199705555483194413832902302373511490858360959114097755447464088887287145428704637498873563", 0);
+    mpz_init_set_str(g, "105861658449903670398842707812938888531601091401355008230876634024010937268870331311638117904636173888707058855182778532622385692236892785716421644114344195029162371175818169381366740838052666046929986716700970629216177653754852315554730008499152818656193522542478412787555437975470969140718764372166206582283", 0);
+    mpz_init_set_str(q, "783294875021436409578654247252215361374348380322356315904524998417053527857380", 0);
+
+    int n = (int) ((mpz_sizeinbase(p, 2) + limbBits - 1) / limbBits);
+    int qn = (int) ((mpz_sizeinbase(q, 2) + limbBits - 1) / limbBits);
+    int windows = (expBits + bits - 1) / bits;
+    int entries = (1 << bits) - 1;
+
+    //-1/p mod 2^limbBits by Newton iteration, p odd is its own inverse mod 8
+    unsigned long int p0 = mpz_get_ui(p), inv = p0;
+    for (int k = 3; k < limbBits; k *= 2)
+        inv *= 2 - p0 * inv;
+    unsigned long int pinv = -inv;
+    if (limbBits < (int) (sizeof(unsigned long int) * CHAR_BIT))
+        pinv &= (1UL << limbBits) - 1;
+
+    FILE *out = fopen(argv[optind], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not write %s\n", argv[optind]);
+        return 1;
+    }
+
+    fprintf(out, "//Generated by sumFE_gentables -w %d -e %d -l %d, do not edit\n\n", bits, expBits, limbBits);
+    fprintf(out, "#ifndef SUMFE_PARAMS_H\n#define SUMFE_PARAMS_H\n\n");
+    fprintf(out, "#define SFE_PARAM_LIMB_BITS %d\n", limbBits);
+    fprintf(out, "#define SFE_PARAM_LIMBS %d\n", n);
+    fprintf(out, "#define SFE_PARAM_Q_LIMBS %d\n", qn);
+    fprintf(out, "#define SFE_FIXED_BITS %d\n", bits);
+    fprintf(out, "#define SFE_FIXED_WINDOWS %d\n\n", windows);
+
+    emitArray(out, "sfeParamP", p, n, limbBits);
+    emitArray(out, "sfeParamG", g, n, limbBits);
+    fprintf(out, "static const mp_limb_t sfeParamQ[SFE_PARAM_Q_LIMBS] = {");
+    emitLimbs(out, q, qn, limbBits);
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "//-1/p mod B\n#define SFE_PARAM_PINV 0x%0*lx\n\n", limbBits / 4, pinv);
+
+    //Window j, digit d: g^(d * 2^(bits*j)) * R mod p
+    fprintf(out, "static const mp_limb_t sfeFixedG[SFE_FIXED_WINDOWS * %d * SFE_PARAM_LIMBS] = {", entries);
+
+    mpz_t base, x, m;
+    mpz_init_set(base, g);
+    mpz_init(x);
+    mpz_init(m);
+    for (int j = 0; j < windows; j++) {
+        fprintf(out, "\n    //window %d", j);
+        mpz_set(x, base);
+        for (int d = 1; d <= entries; d++) {
+            mpz_mul_2exp(m, x, (mp_bitcnt_t) n * limbBits);
+            mpz_mod(m, m, p);
+            emitLimbs(out, m, n, limbBits);
+            if (j + 1 < windows || d < entries)
+                fputc(',', out);
+
+            mpz_mul(x, x, base);
+            mpz_mod(x, x, p);
+        }
+        for (int k = 0; k < bits; k++) {
+            mpz_mul(base, base, base);
+            mpz_mod(base, base, p);
+        }
+    }
+    fprintf(out, "\n};\n\n#endif\n");
+
+    int ret = fclose(out) == 0 ? 0 : 1;
+    printf("Wrote %s: %d limbs, %d x %d fixed-base entries (%zu bytes)\n", argv[optind], n, windows, entries,
+           (size_t) windows * entries * n * (limbBits / 8));
+
+    mpz_clear(base);
+    mpz_clear(x);
+    mpz_clear(m);
+    mpz_clear(p);
+    mpz_clear(g);
+    mpz_clear(q);
+    return ret;
+}
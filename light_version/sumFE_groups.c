@@ -0,0 +1,173 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumFE_groups.h"
+
+static size_t home(const GroupTable *gt, uint64_t key) {
+    return (size_t) (key * 0x9e3779b97f4a7c15ULL) & gt->mask;
+}
+
+int groupInit(GroupTable *gt, const mpz_t p) {
+    memset(gt, 0, sizeof(*gt));
+    mpz_init_set(gt->p, p);
+    mpz_init_set(gt->order, p);
+    mpz_sub_ui(gt->order, gt->order, 1);
+
+    gt->mask = 63;
+    gt->index = calloc(gt->mask + 1, sizeof(uint32_t));
+    if (gt->index == NULL || montInit(&gt->mod, gt->p) != 0) {
+        groupClear(gt);
+        return -1;
+    }
+    return 0;
+}
+
+void groupClear(GroupTable *gt) {
+    for (size_t i = 0; i < gt->num; i++) {
+        free(gt->groups[i].acc);
+        mpz_clear(gt->groups[i].msk);
+    }
+    free(gt->groups);
+    free(gt->index);
+    mpz_clear(gt->p);
+    mpz_clear(gt->order);
+    gt->groups = NULL;
+    gt->index = NULL;
+    gt->num = 0;
+}
+
+static int growIndex(GroupTable *gt) {
+    size_t mask = 2 * gt->mask + 1;
+    uint32_t *index = calloc(mask + 1, sizeof(uint32_t));
+    if (index == NULL)
+        return -1;
+
+    free(gt->index);
+    gt->index = index;
+    gt->mask = mask;
+    for (size_t g = 0; g < gt->num; g++) {
+        size_t j = home(gt, gt->groups[g].key);
+        while (gt->index[j] != 0)
+            j = (j + 1) & gt->mask;
+        gt->index[j] = (uint32_t) g + 1;
+    }
+    return 0;
+}
+
+GroupAcc *groupGet(GroupTable *gt, uint64_t key) {
+    size_t j = home(gt, key);
+
+    for (; gt->index[j] != 0; j = (j + 1) & gt->mask) {
+        GroupAcc *a = &gt->groups[gt->index[j] - 1];
+        if (a->key == key)
+            return a;
+    }
+
+    //New group; keep the table at most half full
+    if (2 * (gt->num + 1) > gt->mask + 1) {
+        if (growIndex(gt) != 0)
+            return NULL;
+        j = home(gt, key);
+        while (gt->index[j] != 0)
+            j = (j + 1) & gt->mask;
+    }
+
+    if (gt->num == gt->cap) {
+        size_t cap = gt->cap ? 2 * gt->cap : 16;
+        GroupAcc *groups = realloc(gt->groups, cap * sizeof(GroupAcc));
+        if (groups == NULL)
+            return NULL;
+        gt->groups = groups;
+        gt->cap = cap;
+    }
+
+    GroupAcc *a = &gt->groups[gt->num];
+    a->acc = calloc(gt->mod.n, sizeof(mp_limb_t));
+    if (a->acc == NULL)
+        return NULL;
+    a->acc[0] = 1;
+    a->key = key;
+    a->count = 0;
+    mpz_init(a->msk);
+
+    gt->index[j] = (uint32_t) ++gt->num;
+    return a;
+}
+
+int groupAddCipher(GroupTable *gt, uint64_t key, const mpz_t second) {
+    mp_limb_t c[MONT_MAX_LIMBS];
+    GroupAcc *a = groupGet(gt, key);
+    if (a == NULL)
+        return -1;
+
+    //Well-formed secondcomps are already reduced, the check is one compare
+    mpz_srcptr x = second;
+    mpz_t t;
+    mpz_init(t);
+    if (mpz_sgn(second) < 0 || mpz_cmp(second, gt->p) >= 0) {
+        mpz_mod(t, second, gt->p);
+        x = t;
+    }
+
+    size_t xn = mpz_size(x);
+    memcpy(c, mpz_limbs_read(x), xn * sizeof(mp_limb_t));
+    memset(c + xn, 0, (gt->mod.n - xn) * sizeof(mp_limb_t));
+    mpz_clear(t);
+
+    montMul(a->acc, a->acc, c, &gt->mod);
+    a->count++;
+    return 0;
+}
+
+int groupAddKey(GroupTable *gt, uint64_t key, const mpz_t secKey) {
+    GroupAcc *a = groupGet(gt, key);
+    if (a == NULL)
+        return -1;
+
+    mpz_add(a->msk, a->msk, secKey);
+    if (mpz_cmp(a->msk, gt->order) >= 0)
+        mpz_mod(a->msk, a->msk, gt->order);
+    return 0;
+}
+
+void groupProduct(const GroupTable *gt, const GroupAcc *a, mpz_t prod) {
+    mpz_t r, view;
+
+    //acc * R^count mod p, R = 2^(limb bits * n)
+    mpz_init_set_ui(r, 1);
+    mpz_mul_2exp(r, r, (mp_bitcnt_t) gt->mod.n * sizeof(mp_limb_t) * CHAR_BIT);
+    mpz_mod(r, r, gt->p);
+    mpz_powm_ui(r, r, a->count, gt->p);
+
+    mpz_mul(prod, r, mpz_roinit_n(view, a->acc, gt->mod.n));
+    mpz_mod(prod, prod, gt->p);
+    mpz_clear(r);
+}
+
+int groupDecrypt(const GroupTable *gt, const mpz_t firstcomp, mpz_t *plain) {
+    MontFixedBase c1;
+    int table = gt->num >= GROUP_TABLE_MIN
+        && montFixedInit(&c1, &gt->mod, firstcomp, 4, mpz_sizeinbase(gt->p, 2)) == 0;
+
+    mpz_t e, c1e;
+    mpz_init(e);
+    mpz_init(c1e);
+
+    //plain = prod * c1^(p-1-msk), the key is divided out without an inversion
+    for (size_t i = 0; i < gt->num; i++) {
+        mpz_sub(e, gt->order, gt->groups[i].msk);
+        if (!table || montFixedPow(c1e, &c1, e) != 0)
+            mpz_powm(c1e, firstcomp, e, gt->p);
+
+        groupProduct(gt, &gt->groups[i], plain[i]);
+        mpz_mul(plain[i], plain[i], c1e);
+        mpz_mod(plain[i], plain[i], gt->p);
+    }
+
+    mpz_clear(e);
+    mpz_clear(c1e);
+    if (table)
+        montFixedClear(&c1);
+    return 0;
+}
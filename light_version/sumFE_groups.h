@@ -0,0 +1,66 @@
+#ifndef SUMFE_GROUPS_H
+#define SUMFE_GROUPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+#include "sumFE_mont.h"
+
+//Group-by aggregation: one running product (as addCipher) and one key sum
+//per group key, e.g. a region or device class.
+//
+//Groups are kept densely in insertion order and found through an
+//open-addressing table on the key. A product is kept as n limbs multiplied
+//with montMul, so folding a ciphertext is one Montgomery multiplication,
+//whatever the number of groups; each multiplication leaves a factor R^-1 that
+//is taken out once when the product is read.
+
+//From this many groups on, groupDecrypt builds a fixed-base table for g^r
+#ifndef GROUP_TABLE_MIN
+#define GROUP_TABLE_MIN 8
+#endif
+
+typedef struct {
+    uint64_t key;
+    uint64_t count;             //ciphertexts folded
+    mp_limb_t *acc;             //product * R^-count mod p
+    mpz_t msk;                  //sum of the group's keys mod p-1
+} GroupAcc;
+
+typedef struct {
+    GroupAcc *groups;
+    size_t num;
+    size_t cap;
+    uint32_t *index;            //group number + 1, 0 for a free entry
+    size_t mask;
+    mpz_t p;
+    mpz_t order;                //p-1
+    MontParams mod;
+} GroupTable;
+
+//0 on success, -1 if p is not usable for montMul or memory ran out
+int groupInit(GroupTable *gt, const mpz_t p);
+void groupClear(GroupTable *gt);
+
+//Accumulator of a group, created empty on first use; NULL if memory ran out.
+//The pointer is valid until the next group is created.
+GroupAcc *groupGet(GroupTable *gt, uint64_t key);
+
+//Fold a ciphertext's secondcomp / a member's key into a group; 0 on success
+int groupAddCipher(GroupTable *gt, uint64_t key, const mpz_t second);
+int groupAddKey(GroupTable *gt, uint64_t key, const mpz_t secKey);
+
+//Product mod p of the group's secondcomps
+void groupProduct(const GroupTable *gt, const GroupAcc *a, mpz_t prod);
+
+//Decrypt every group at once: plain[i] = g^(sum of group i), groups in
+//insertion order, all sharing firstcomp = g^r. Returns 0 on success.
+int groupDecrypt(const GroupTable *gt, const mpz_t firstcomp, mpz_t *plain);
+
+#endif
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mini-gmp.h"
+#include "sumFE_arena.h"
+#include "sumFE_io.h"
+
+//Bulk importer for the decimal ciphertext.txt/keypair.txt files written by
+//earlier versions of the light client (one mpz_out_str base 10 number each).
+//Files are parsed in parallel and written as records of one binary batch
+//file, record i holding input file i.
+//
+//  sumFE_import [-t threads] [-k] [-e epoch] [-l list] out.bin [file ...]
+//
+//  -k   the inputs are keys (reduced mod p-1) instead of ciphertexts (mod p)
+//  -l   read the input paths from a file, one per line
+
+//Chunks up to this many digits go through mpz_set_str directly
+#define LEAF_DIGITS 512
+
+typedef struct {
+    char **paths;
+    size_t num;
+    size_t next;
+    pthread_mutex_t lock;
+
+    mpz_t *pow10;                   //pow10[i] = 10^(LEAF_DIGITS << i)
+    int levels;
+    mpz_t mod;
+    SfeHeader hdr;
+    int fd;
+    size_t failed;
+} ImportJob;
+
+//Subquadratic radix conversion: split off the low LEAF_DIGITS << k digits,
+//convert both halves recursively and recombine as hi * 10^(LEAF_DIGITS << k) + lo
+static void parseDecimal(mpz_t r, const char *s, size_t n, mpz_t *pow10) {
+    if (n <= LEAF_DIGITS) {
+        char buf[LEAF_DIGITS + 1];
+        memcpy(buf, s, n);
+        buf[n] = '\0';
+        mpz_set_str(r, buf, 10);
+        return;
+    }
+
+    int k = 0;
+    while (((size_t) LEAF_DIGITS << (k + 1)) < n)
+        k++;
+    size_t lo_len = (size_t) LEAF_DIGITS << k;
+
+    mpz_t lo;
+    mpz_init(lo);
+    parseDecimal(r, s, n - lo_len, pow10);
+    parseDecimal(lo, s + n - lo_len, lo_len, pow10);
+    mpz_mul(r, r, pow10[k]);
+    mpz_add(r, r, lo);
+    mpz_clear(lo);
+}
+
+static char *readDigits(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *buf = malloc((size_t) st.st_size + 1);
+    size_t n = buf ? fread(buf, 1, (size_t) st.st_size, fp) : 0;
+    fclose(fp);
+    if (buf == NULL)
+        return NULL;
+
+    //mpz_out_str output, possibly followed by a newline
+    while (n > 0 && isspace((unsigned char) buf[n - 1]))
+        n--;
+    for (size_t i = 0; i < n; i++) {
+        if (!isdigit((unsigned char) buf[i])) {
+            free(buf);
+            return NULL;
+        }
+    }
+
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
+static void putId(unsigned char *rec, uint32_t user, uint32_t epochOffset) {
+    for (int i = 0; i < 4; i++) {
+        rec[3 - i] = (unsigned char) (user >> (8 * i));
+        rec[7 - i] = (unsigned char) (epochOffset >> (8 * i));
+    }
+}
+
+static int importOne(ImportJob *job, size_t idx) {
+    unsigned char rec[SFE_RECORD_ID_SIZE + SFE_FIELD_SIZE];
+    size_t len;
+    int ret = -1;
+
+    char *digits = readDigits(job->paths[idx], &len);
+    if (digits != NULL && len > 0) {
+        size_t mark = arenaEpochBegin();
+
+        mpz_t x;
+        mpz_init(x);
+        parseDecimal(x, digits, len, job->pow10);
+        mpz_mod(x, x, job->mod);
+
+        //Record id: the input index, epoch offset 0
+        putId(rec, (uint32_t) idx, 0);
+        ret = sfeEncodeField(rec + SFE_RECORD_ID_SIZE, SFE_FIELD_SIZE, x);
+
+        mpz_clear(x);
+        arenaEpochEnd(mark);
+    }
+    free(digits);
+
+    //Leave a record that belongs to no epoch rather than a hole of zeros
+    if (ret != 0) {
+        memset(rec, 0, sizeof(rec));
+        putId(rec, (uint32_t) idx, SFE_OFFSET_NONE);
+    }
+
+    //Records are fixed width, so every thread writes its own slot directly
+    off_t off = SFE_HEADER_SIZE + (off_t) idx * (off_t) sizeof(rec);
+    if (pwrite(job->fd, rec, sizeof(rec), off) != (ssize_t) sizeof(rec))
+        ret = -1;
+    return ret;
+}
+
+static void *importWorker(void *arg) {
+    ImportJob *job = arg;
+    size_t failed = 0;
+
+    arenaThreadInit(0);
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t idx = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (idx >= job->num)
+            break;
+
+        if (importOne(job, idx) != 0) {
+            fprintf(stderr, "Could not import %s\n", job->paths[idx]);
+            failed++;
+        }
+    }
+
+    arenaThreadFree();
+
+    pthread_mutex_lock(&job->lock);
+    job->failed += failed;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+static void freeList(char **list, size_t num) {
+    for (size_t i = 0; i < num; i++)
+        free(list[i]);
+    free(list);
+}
+
+static char **readList(const char *path, size_t *num) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return NULL;
+
+    size_t cap = 1024, n = 0;
+    char **list = malloc(cap * sizeof(char *));
+    char line[4096];
+    int failed = list == NULL;
+
+    while (!failed && fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        if (n == cap) {
+            char **grown = realloc(list, 2 * cap * sizeof(char *));
+            if (grown == NULL) {
+                failed = 1;
+                break;
+            }
+            list = grown;
+            cap *= 2;
+        }
+        if ((list[n] = strdup(line)) == NULL)
+            failed = 1;
+        else
+            n++;
+    }
+    if (ferror(fp))
+        failed = 1;
+    fclose(fp);
+
+    if (failed) {
+        if (list != NULL)
+            freeList(list, n);
+        return NULL;
+    }
+
+    *num = n;
+    return list;
+}
+
+int main(int argc, char **argv) {
+    mpz_t p,g;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int keys = 0;
+    uint64_t epoch = 0;
+    const char *list = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:ke:l:")) != -1) {
+        switch (opt) {
+        case 't': threads = atoi(optarg); break;
+        case 'k': keys = 1; break;
+        case 'e': epoch = strtoull(optarg, NULL, 0); break;
+        case 'l': list = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-k] [-e epoch] [-l list] out.bin [file ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-t threads] [-k] [-e epoch] [-l list] out.bin [file ...]\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1)
+        threads = 1;
+
+    //Parsing allocates on every thread, keep it thread local
+    arenaInstall();
+
+    mpz_init_set_str(p, "141103728801468755249503291901801300339454489134873273269161807133184957725631203791969744406992490029017308434294093310271973777802513443575042969796895750747614660497411432558300476234836462151925376765365205539666438199705555483194413832902302373511490858360959114097755447464088887287145428704637498873563", 0);
+    mpz_init_set_str(g, "105861658449903670398842707812938888531601091401355008230876634024010937268870331311638117904636173888707058855182778532622385692236892785716421644114344195029162371175818169381366740838052666046929986716700970629216177653754852315554730008499152818656193522542478412787555437975470969140718764372166206582283", 0);
+
+    ImportJob job;
+    memset(&job, 0, sizeof(job));
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (list != NULL) {
+        job.paths = readList(list, &job.num);
+        if (job.paths == NULL) {
+            fprintf(stderr, "Could not read %s\n", list);
+            return 1;
+        }
+    } else {
+        job.paths = argv + optind + 1;
+        job.num = (size_t) (argc - optind - 1);
+    }
+
+    //Ciphertexts are reduced mod p, keys (exponents) mod p-1
+    mpz_init_set(job.mod, p);
+    if (keys)
+        mpz_sub_ui(job.mod, job.mod, 1);
+
+    //Share the powers of ten between threads, sized for the longest input
+    size_t longest = 0;
+    for (size_t i = 0; i < job.num; i++) {
+        struct stat st;
+        if (stat(job.paths[i], &st) == 0 && (size_t) st.st_size > longest)
+            longest = (size_t) st.st_size;
+    }
+    job.levels = 1;
+    while (((size_t) LEAF_DIGITS << job.levels) < longest)
+        job.levels++;
+    job.pow10 = malloc(job.levels * sizeof(mpz_t));
+    if (job.pow10 == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    mpz_init(job.pow10[0]);
+    mpz_ui_pow_ui(job.pow10[0], 10, LEAF_DIGITS);
+    for (int i = 1; i < job.levels; i++) {
+        mpz_init(job.pow10[i]);
+        mpz_mul(job.pow10[i], job.pow10[i - 1], job.pow10[i - 1]);
+    }
+
+    if (keys)
+        sfeInitHeader(&job.hdr, SFE_KIND_KEY, 1, sfeFingerprint(p, g), epoch);
+    else {
+        //Legacy files only hold secondcomp, so the batch is compact
+        sfeInitHeader(&job.hdr, SFE_KIND_CIPHERTEXT, 1, sfeFingerprint(p, g), epoch);
+        job.hdr.flags |= SFE_FLAG_COMPACT;
+    }
+    job.hdr.count = job.num;
+
+    FILE *out = fopen(argv[optind], "wb");
+    if (out == NULL || sfeWriteHeader(out, &job.hdr) != 0 || fflush(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", argv[optind]);
+        return 1;
+    }
+    job.fd = fileno(out);
+
+    //Workers share one queue, so running with fewer threads than asked for
+    //(or none, on this thread) only costs time
+    pthread_t *tid = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    while (tid != NULL && started < threads && pthread_create(&tid[started], NULL, importWorker, &job) == 0)
+        started++;
+    if (started == 0)
+        importWorker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    free(tid);
+
+    int ret = fclose(out) == 0 && job.failed == 0 ? 0 : 1;
+    printf("Imported %zu of %zu files into %s\n", job.num - job.failed, job.num, argv[optind]);
+
+    for (int i = 0; i < job.levels; i++)
+        mpz_clear(job.pow10[i]);
+    free(job.pow10);
+    if (list != NULL)
+        freeList(job.paths, job.num);
+    return ret;
+}
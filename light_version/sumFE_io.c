@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sumFE_io.h"
+
+static void putU16(unsigned char *b, uint16_t v) {
+    b[0] = (unsigned char) (v >> 8);
+    b[1] = (unsigned char) v;
+}
+
+static void putU32(unsigned char *b, uint32_t v) {
+    for (int i = 3; i >= 0; i--, v >>= 8)
+        b[i] = (unsigned char) v;
+}
+
+static void putU64(unsigned char *b, uint64_t v) {
+    for (int i = 7; i >= 0; i--, v >>= 8)
+        b[i] = (unsigned char) v;
+}
+
+static uint16_t getU16(const unsigned char *b) {
+    return (uint16_t) ((b[0] << 8) | b[1]);
+}
+
+static uint32_t getU32(const unsigned char *b) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v = (v << 8) | b[i];
+    return v;
+}
+
+static uint64_t getU64(const unsigned char *b) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v = (v << 8) | b[i];
+    return v;
+}
+
+void sfeInitHeader(SfeHeader *h, uint16_t kind, uint32_t fields, uint64_t fingerprint, uint64_t epoch) {
+    h->version = SFE_VERSION;
+    h->flags = 0;
+    h->kind = kind;
+    h->fieldSize = SFE_FIELD_SIZE;
+    h->fields = fields;
+    h->fingerprint = fingerprint;
+    h->epoch = epoch;
+    h->count = 0;
+    h->keySet = 0;
+}
+
+uint64_t sfeFingerprint(const mpz_t p, const mpz_t g) {
+    unsigned char buf[SFE_FIELD_SIZE];
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const mpz_srcptr v[2] = { p, g };
+
+    for (int k = 0; k < 2; k++) {
+        if (sfeEncodeField(buf, sizeof(buf), v[k]) != 0)
+            return 0;
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            hash ^= buf[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+size_t sfeRecordSize(const SfeHeader *h) {
+    return SFE_RECORD_ID_SIZE + (size_t) h->fields * h->fieldSize;
+}
+
+int sfeWriteHeader(FILE *fp, const SfeHeader *h) {
+    unsigned char b[SFE_HEADER_SIZE];
+
+    memset(b, 0, sizeof(b));
+    memcpy(b, SFE_MAGIC, 4);
+    putU16(b + 4, h->version);
+    putU16(b + 6, h->flags);
+    putU16(b + 8, h->kind);
+    putU16(b + 10, h->fieldSize);
+    putU32(b + 12, h->fields);
+    putU64(b + 16, h->fingerprint);
+    putU64(b + 24, h->epoch);
+    putU64(b + 32, h->count);
+    putU64(b + 40, h->keySet);
+
+    return fwrite(b, 1, sizeof(b), fp) == sizeof(b) ? 0 : -1;
+}
+
+static int parseHeader(const unsigned char *b, SfeHeader *h) {
+    if (memcmp(b, SFE_MAGIC, 4) != 0)
+        return -1;
+
+    h->version = getU16(b + 4);
+    h->flags = getU16(b + 6);
+    h->kind = getU16(b + 8);
+    h->fieldSize = getU16(b + 10);
+    h->fields = getU32(b + 12);
+    h->fingerprint = getU64(b + 16);
+    h->epoch = getU64(b + 24);
+    h->count = getU64(b + 32);
+    h->keySet = getU64(b + 40);
+
+    if (h->version != SFE_VERSION || h->fieldSize == 0 || h->fields == 0)
+        return -1;
+    if ((h->flags & SFE_FLAG_LIMBS) && h->fieldSize % 8 != 0)
+        return -1;
+    return 0;
+}
+
+int sfeReadHeader(FILE *fp, SfeHeader *h) {
+    unsigned char b[SFE_HEADER_SIZE];
+
+    if (fread(b, 1, sizeof(b), fp) != sizeof(b))
+        return -1;
+    return parseHeader(b, h);
+}
+
+int sfeFinish(FILE *fp, uint64_t count) {
+    unsigned char b[8];
+
+    putU64(b, count);
+    if (fseek(fp, 32, SEEK_SET) != 0)
+        return -1;
+    if (fwrite(b, 1, sizeof(b), fp) != sizeof(b))
+        return -1;
+    return fseek(fp, 0, SEEK_END);
+}
+
+int sfeEncodeField(unsigned char *buf, size_t width, const mpz_t x) {
+    size_t len = (mpz_sizeinbase(x, 2) + 7) / 8;
+
+    if (mpz_sgn(x) < 0 || len > width)
+        return -1;
+
+    memset(buf, 0, width);
+    if (mpz_sgn(x) != 0)
+        mpz_export(buf + width - len, NULL, 1, 1, 1, 0, x);
+    return 0;
+}
+
+void sfeDecodeField(mpz_t x, const unsigned char *buf, size_t width) {
+    mpz_import(x, width, 1, 1, 1, 0, buf);
+}
+
+int sfeEncodeFieldLimbs(unsigned char *buf, size_t width, const mpz_t x) {
+    size_t len = (mpz_sizeinbase(x, 2) + 63) / 64 * 8;
+
+    if (mpz_sgn(x) < 0 || len > width || width % 8 != 0)
+        return -1;
+
+    memset(buf, 0, width);
+    if (mpz_sgn(x) != 0)
+        mpz_export(buf, NULL, -1, 8, -1, 0, x);
+    return 0;
+}
+
+void sfeDecodeFieldLimbs(mpz_t x, const unsigned char *buf, size_t width) {
+    mpz_import(x, width / 8, -1, 8, -1, 0, buf);
+}
+
+int sfeWriteId(FILE *fp, uint32_t user, uint32_t epochOffset) {
+    unsigned char id[SFE_RECORD_ID_SIZE];
+
+    putU32(id, user);
+    putU32(id + 4, epochOffset);
+    return fwrite(id, 1, sizeof(id), fp) == sizeof(id) ? 0 : -1;
+}
+
+int sfeReadId(FILE *fp, uint32_t *user, uint32_t *epochOffset) {
+    unsigned char id[SFE_RECORD_ID_SIZE];
+
+    if (fread(id, 1, sizeof(id), fp) != sizeof(id))
+        return -1;
+    if (user)
+        *user = getU32(id);
+    if (epochOffset)
+        *epochOffset = getU32(id + 4);
+    return 0;
+}
+
+int sfeWriteField(FILE *fp, const SfeHeader *h, const mpz_t x) {
+    unsigned char buf[SFE_FIELD_SIZE];
+    unsigned char *b = h->fieldSize <= sizeof(buf) ? buf : malloc(h->fieldSize);
+
+    if (b == NULL)
+        return -1;
+
+    int ret = (h->flags & SFE_FLAG_LIMBS) ? sfeEncodeFieldLimbs(b, h->fieldSize, x)
+                                          : sfeEncodeField(b, h->fieldSize, x);
+    if (ret == 0 && fwrite(b, 1, h->fieldSize, fp) != h->fieldSize)
+        ret = -1;
+
+    if (b != buf)
+        free(b);
+    return ret;
+}
+
+int sfeReadField(FILE *fp, const SfeHeader *h, mpz_t x) {
+    unsigned char buf[SFE_FIELD_SIZE];
+    unsigned char *b = h->fieldSize <= sizeof(buf) ? buf : malloc(h->fieldSize);
+
+    if (b == NULL)
+        return -1;
+
+    int ret = 0;
+    if (fread(b, 1, h->fieldSize, fp) != h->fieldSize)
+        ret = -1;
+    else if (h->flags & SFE_FLAG_LIMBS)
+        sfeDecodeFieldLimbs(x, b, h->fieldSize);
+    else
+        sfeDecodeField(x, b, h->fieldSize);
+
+    if (b != buf)
+        free(b);
+    return ret;
+}
+
+int sfeWriteRecord(FILE *fp, const SfeHeader *h, uint32_t user, uint32_t epochOffset, mpz_t *values) {
+    if (sfeWriteId(fp, user, epochOffset) != 0)
+        return -1;
+    for (uint32_t i = 0; i < h->fields; i++) {
+        if (sfeWriteField(fp, h, values[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int sfeReadRecord(FILE *fp, const SfeHeader *h, uint32_t *user, uint32_t *epochOffset, mpz_t *values) {
+    if (sfeReadId(fp, user, epochOffset) != 0)
+        return -1;
+    for (uint32_t i = 0; i < h->fields; i++) {
+        if (sfeReadField(fp, h, values[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int sfeSave(const char *path, const SfeHeader *h, mpz_t *values) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    SfeHeader hdr = *h;
+    hdr.count = 1;
+
+    int ret = sfeWriteHeader(fp, &hdr);
+    if (ret == 0)
+        ret = sfeWriteRecord(fp, &hdr, 0, 0, values);
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+int sfeLoad(const char *path, SfeHeader *h, mpz_t *values, uint32_t maxFields) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    int ret = sfeReadHeader(fp, h);
+    if (ret == 0 && h->fields > maxFields)
+        ret = -1;
+    if (ret == 0)
+        ret = sfeReadRecord(fp, h, NULL, NULL, values);
+
+    fclose(fp);
+    return ret;
+}
+
+//Mapped limbs can be used in place on little-endian hosts, whatever the limb size
+static int hostMatchesLimbs(void) {
+    const mp_limb_t one = 1;
+    return 8 % sizeof(mp_limb_t) == 0 && *(const unsigned char *) &one == 1;
+}
+
+int sfeMapOpen(SfeMap *m, const char *path) {
+    struct stat st;
+
+    memset(m, 0, sizeof(*m));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < SFE_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    m->base = base;
+    m->length = (size_t) st.st_size;
+    if (parseHeader(m->base, &m->hdr) != 0) {
+        sfeMapClose(m);
+        return -1;
+    }
+
+    m->records = m->base + SFE_HEADER_SIZE;
+    m->recordSize = sfeRecordSize(&m->hdr);
+
+    //A count of 0 means the writer did not know it: take what is there
+    uint64_t avail = (m->length - SFE_HEADER_SIZE) / m->recordSize;
+    m->count = m->hdr.count == 0 ? avail : m->hdr.count;
+    if (m->count > avail) {
+        sfeMapClose(m);
+        return -1;
+    }
+
+    m->direct = (m->hdr.flags & SFE_FLAG_LIMBS) && hostMatchesLimbs();
+    madvise((void *) m->base, m->length, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void sfeMapClose(SfeMap *m) {
+    if (m->base != NULL)
+        munmap((void *) m->base, m->length);
+    m->base = NULL;
+    m->length = 0;
+    m->count = 0;
+}
+
+void sfeMapId(const SfeMap *m, uint64_t i, uint32_t *user, uint32_t *epochOffset) {
+    const unsigned char *rec = m->records + i * m->recordSize;
+
+    if (user)
+        *user = getU32(rec);
+    if (epochOffset)
+        *epochOffset = getU32(rec + 4);
+}
+
+mpz_srcptr sfeMapField(const SfeMap *m, uint64_t i, uint32_t j, mpz_t view, mpz_t scratch) {
+    const unsigned char *f = m->records + i * m->recordSize + SFE_RECORD_ID_SIZE + (size_t) j * m->hdr.fieldSize;
+
+    if (m->direct)
+        return mpz_roinit_n(view, (mp_srcptr) f, m->hdr.fieldSize / sizeof(mp_limb_t));
+
+    if (m->hdr.flags & SFE_FLAG_LIMBS)
+        sfeDecodeFieldLimbs(scratch, f, m->hdr.fieldSize);
+    else
+        sfeDecodeField(scratch, f, m->hdr.fieldSize);
+    return scratch;
+}
@@ -0,0 +1,134 @@
+#ifndef SUMFE_IO_H
+#define SUMFE_IO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Binary container for keys and ciphertexts.
+//
+//A file is a 64-byte header followed by `count` fixed-width records. All
+//integers are big-endian. Every record starts with an 8-byte id (user slot
+//and epoch offset from the header epoch) followed by `fields` values of
+//`fieldSize` bytes each, stored big-endian and left-padded with zeros.
+//
+//  offset  size  contents
+//       0     4  magic "SFEB"
+//       4     2  version
+//       6     2  flags
+//       8     2  kind (SFE_KIND_*)
+//      10     2  field size in bytes
+//      12     4  fields per record
+//      16     8  parameter-set fingerprint (sfeFingerprint)
+//      24     8  epoch
+//      32     8  record count, 0 when unknown (read until EOF)
+//      40     8  key set the file belongs to, 0 if none (see keyStoreId)
+//      48    16  reserved, zero
+
+#define SFE_MAGIC "SFEB"
+#define SFE_VERSION 1
+#define SFE_HEADER_SIZE 64
+#define SFE_RECORD_ID_SIZE 8
+
+//Epoch offset of a record that holds no value (e.g. a failed import)
+#define SFE_OFFSET_NONE 0xffffffffu
+
+//128 bytes holds any value reduced mod the 1024-bit p
+#define SFE_FIELD_SIZE 128
+
+#define SFE_KIND_CIPHERTEXT 1
+#define SFE_KIND_KEY 2
+
+//Per-epoch aggregates of a range store (see sumFE_range.h)
+#define SFE_KIND_RANGE 3
+
+//State of a master key (see sumFE_master.h)
+#define SFE_KIND_MASTER 4
+
+//Ciphertext records carry only secondcomp; firstcomp is rebuilt from the
+//epoch context (see sumFE_epoch.h)
+#define SFE_FLAG_COMPACT 0x0001
+
+//Fields are stored as little-endian 64-bit words, least significant word
+//first. On little-endian hosts that is the in-memory limb layout, so mapped
+//records can be used as mpz values without decoding (see sfeMapField)
+#define SFE_FLAG_LIMBS 0x0002
+
+//The records are followed by an index (see sumFE_keys.h)
+#define SFE_FLAG_INDEXED 0x0004
+
+typedef struct {
+    uint16_t version;
+    uint16_t flags;
+    uint16_t kind;
+    uint16_t fieldSize;
+    uint32_t fields;
+    uint64_t fingerprint;
+    uint64_t epoch;
+    uint64_t count;
+    uint64_t keySet;
+} SfeHeader;
+
+//Fill a header for the given parameters with the default field size
+void sfeInitHeader(SfeHeader *h, uint16_t kind, uint32_t fields, uint64_t fingerprint, uint64_t epoch);
+
+//FNV-1a over the fixed-width encodings of p and g
+uint64_t sfeFingerprint(const mpz_t p, const mpz_t g);
+
+size_t sfeRecordSize(const SfeHeader *h);
+
+//All functions below return 0 on success and -1 on failure
+int sfeWriteHeader(FILE *fp, const SfeHeader *h);
+int sfeReadHeader(FILE *fp, SfeHeader *h);
+
+//Rewrite the count of a header written at the start of a seekable stream
+int sfeFinish(FILE *fp, uint64_t count);
+
+//A record is an id followed by h->fields values
+int sfeWriteId(FILE *fp, uint32_t user, uint32_t epochOffset);
+int sfeReadId(FILE *fp, uint32_t *user, uint32_t *epochOffset);
+int sfeWriteField(FILE *fp, const SfeHeader *h, const mpz_t x);
+int sfeReadField(FILE *fp, const SfeHeader *h, mpz_t x);
+
+int sfeWriteRecord(FILE *fp, const SfeHeader *h, uint32_t user, uint32_t epochOffset, mpz_t *values);
+int sfeReadRecord(FILE *fp, const SfeHeader *h, uint32_t *user, uint32_t *epochOffset, mpz_t *values);
+
+//Fixed-width encoding of a single value (fails if x does not fit)
+int sfeEncodeField(unsigned char *buf, size_t width, const mpz_t x);
+void sfeDecodeField(mpz_t x, const unsigned char *buf, size_t width);
+
+//Same, in the SFE_FLAG_LIMBS layout (width must be a multiple of 8)
+int sfeEncodeFieldLimbs(unsigned char *buf, size_t width, const mpz_t x);
+void sfeDecodeFieldLimbs(mpz_t x, const unsigned char *buf, size_t width);
+
+//Read-only memory mapping of a whole file
+typedef struct {
+    SfeHeader hdr;
+    const unsigned char *base;
+    size_t length;
+    const unsigned char *records;
+    uint64_t count;
+    size_t recordSize;
+    int direct;                 //fields can be wrapped in place
+} SfeMap;
+
+int sfeMapOpen(SfeMap *m, const char *path);
+void sfeMapClose(SfeMap *m);
+
+//Field j of record i. When the file uses the limb layout and it matches the
+//host, `view` is pointed at the mapped limbs (nothing is copied, and view must
+//not be cleared); otherwise the value is decoded into `scratch`. Returns the
+//one that holds the value.
+mpz_srcptr sfeMapField(const SfeMap *m, uint64_t i, uint32_t j, mpz_t view, mpz_t scratch);
+void sfeMapId(const SfeMap *m, uint64_t i, uint32_t *user, uint32_t *epochOffset);
+
+//Convenience wrappers for single-record files such as keypair.bin
+int sfeSave(const char *path, const SfeHeader *h, mpz_t *values);
+int sfeLoad(const char *path, SfeHeader *h, mpz_t *values, uint32_t maxFields);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sumFE_keys.h"
+
+static mp_limb_t *slot(const KeyStore *ks, size_t i) {
+    return ks->keys + i * 2 * (size_t) ks->limbs;
+}
+
+int keyStoreInit(KeyStore *ks, size_t count, mp_size_t limbs) {
+    ks->count = count;
+    ks->limbs = limbs;
+    ks->keys = calloc(count * 2, limbs * sizeof(mp_limb_t));
+    return ks->keys != NULL || count == 0 ? 0 : -1;
+}
+
+void keyStoreFree(KeyStore *ks) {
+    free(ks->keys);
+    ks->keys = NULL;
+    ks->count = 0;
+}
+
+static int putValue(mp_limb_t *dst, mp_size_t limbs, const mpz_t x) {
+    size_t n = mpz_size(x);
+
+    if (mpz_sgn(x) < 0 || n > (size_t) limbs)
+        return -1;
+    if (n > 0)
+        memcpy(dst, mpz_limbs_read(x), n * sizeof(mp_limb_t));
+    memset(dst + n, 0, (limbs - n) * sizeof(mp_limb_t));
+    return 0;
+}
+
+int keyStoreSet(KeyStore *ks, size_t i, const mpz_t secKey, const mpz_t pubKey) {
+    if (i >= ks->count)
+        return -1;
+    if (putValue(slot(ks, i), ks->limbs, secKey) != 0)
+        return -1;
+    return putValue(slot(ks, i) + ks->limbs, ks->limbs, pubKey);
+}
+
+mpz_srcptr keyStoreSec(const KeyStore *ks, size_t i, mpz_t view) {
+    return mpz_roinit_n(view, slot(ks, i), ks->limbs);
+}
+
+mpz_srcptr keyStorePub(const KeyStore *ks, size_t i, mpz_t view) {
+    return mpz_roinit_n(view, slot(ks, i) + ks->limbs, ks->limbs);
+}
+
+uint64_t keyStoreId(const KeyStore *ks) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t n = ks->count * 2 * (size_t) ks->limbs;
+
+    for (size_t i = 0; i < n; i++) {
+        mp_limb_t limb = ks->keys[i];
+        for (size_t j = 0; j < sizeof(mp_limb_t); j++, limb >>= 8) {
+            hash ^= (unsigned char) limb;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash != 0 ? hash : 1;
+}
+
+#define INDEX_ENTRY_SIZE 16
+
+static void putU64(unsigned char *b, uint64_t v) {
+    for (int i = 7; i >= 0; i--, v >>= 8)
+        b[i] = (unsigned char) v;
+}
+
+static uint64_t getU64(const unsigned char *b) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v = (v << 8) | b[i];
+    return v;
+}
+
+uint64_t keyIdHash(const char *id) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (; *id != '\0'; id++) {
+        hash ^= (unsigned char) *id;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+typedef struct {
+    uint64_t hash;
+    uint64_t slot;
+} IndexEntry;
+
+static int compareEntries(const void *a, const void *b) {
+    const IndexEntry *x = a, *y = b;
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+int keyFileWrite(const char *path, const KeyStore *ks, const uint64_t *hashes, uint64_t fingerprint) {
+    IndexEntry *index = malloc((ks->count > 0 ? ks->count : 1) * sizeof(IndexEntry));
+    if (index == NULL)
+        return -1;
+
+    for (size_t i = 0; i < ks->count; i++) {
+        index[i].hash = hashes[i];
+        index[i].slot = i;
+    }
+    qsort(index, ks->count, sizeof(IndexEntry), compareEntries);
+
+    int ret = 0;
+    for (size_t i = 1; i < ks->count; i++) {
+        if (index[i].hash == index[i - 1].hash)
+            ret = -1;
+    }
+
+    SfeHeader hdr;
+    sfeInitHeader(&hdr, SFE_KIND_KEY, 2, fingerprint, 0);
+    hdr.flags |= SFE_FLAG_LIMBS | SFE_FLAG_INDEXED;
+    hdr.count = ks->count;
+    hdr.keySet = keyStoreId(ks);
+
+    FILE *fp = ret == 0 ? fopen(path, "wb") : NULL;
+    if (fp == NULL) {
+        free(index);
+        return -1;
+    }
+
+    ret = sfeWriteHeader(fp, &hdr);
+    for (size_t i = 0; ret == 0 && i < ks->count; i++) {
+        mpz_t sec, pub;
+        ret = sfeWriteId(fp, (uint32_t) i, 0);
+        if (ret == 0)
+            ret = sfeWriteField(fp, &hdr, keyStoreSec(ks, i, sec));
+        if (ret == 0)
+            ret = sfeWriteField(fp, &hdr, keyStorePub(ks, i, pub));
+    }
+
+    for (size_t i = 0; ret == 0 && i < ks->count; i++) {
+        unsigned char e[INDEX_ENTRY_SIZE];
+        putU64(e, index[i].hash);
+        putU64(e + 8, index[i].slot);
+        if (fwrite(e, 1, sizeof(e), fp) != sizeof(e))
+            ret = -1;
+    }
+
+    if (fclose(fp) != 0)
+        ret = -1;
+    free(index);
+    return ret;
+}
+
+int keyFileOpen(KeyFile *kf, const char *path) {
+    kf->index = NULL;
+    if (sfeMapOpen(&kf->map, path) != 0)
+        return -1;
+
+    const SfeHeader *h = &kf->map.hdr;
+    size_t indexed = SFE_HEADER_SIZE + kf->map.count * (kf->map.recordSize + INDEX_ENTRY_SIZE);
+    if (h->kind != SFE_KIND_KEY || h->fields != 2 || !(h->flags & SFE_FLAG_INDEXED)
+        || h->count == 0 || kf->map.length < indexed) {
+        sfeMapClose(&kf->map);
+        return -1;
+    }
+
+    //Lookups jump around the file, read ahead only what is asked for
+    kf->index = kf->map.records + kf->map.count * kf->map.recordSize;
+    madvise((void *) kf->map.base, kf->map.length, MADV_RANDOM);
+    return 0;
+}
+
+void keyFileClose(KeyFile *kf) {
+    sfeMapClose(&kf->map);
+    kf->index = NULL;
+}
+
+int64_t keyFileFind(const KeyFile *kf, uint64_t hash) {
+    uint64_t lo = 0, hi = kf->map.count;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint64_t h = getU64(kf->index + mid * INDEX_ENTRY_SIZE);
+
+        if (h == hash) {
+            uint64_t slot = getU64(kf->index + mid * INDEX_ENTRY_SIZE + 8);
+            return slot < kf->map.count ? (int64_t) slot : -1;
+        }
+        if (h < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+mpz_srcptr keyFileSec(const KeyFile *kf, uint64_t i, mpz_t view, mpz_t scratch) {
+    return sfeMapField(&kf->map, i, 0, view, scratch);
+}
+
+mpz_srcptr keyFilePub(const KeyFile *kf, uint64_t i, mpz_t view, mpz_t scratch) {
+    return sfeMapField(&kf->map, i, 1, view, scratch);
+}
@@ -0,0 +1,69 @@
+#ifndef SUMFE_KEYS_H
+#define SUMFE_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+#include "sumFE_io.h"
+
+//Contiguous key store: one fixed-width record per user slot holding the
+//secret key and then the public key, `limbs` limbs each, least significant
+//limb first. Keys are used in place through read-only mpz views.
+typedef struct {
+    size_t count;
+    mp_size_t limbs;
+    mp_limb_t *keys;
+} KeyStore;
+
+//Zeroed store for `count` users with values of up to `limbs` limbs
+int keyStoreInit(KeyStore *ks, size_t count, mp_size_t limbs);
+void keyStoreFree(KeyStore *ks);
+
+//Copy a key pair into slot i; -1 if a value is negative or too wide
+int keyStoreSet(KeyStore *ks, size_t i, const mpz_t secKey, const mpz_t pubKey);
+
+//Views of slot i (view must not be cleared or written)
+mpz_srcptr keyStoreSec(const KeyStore *ks, size_t i, mpz_t view);
+mpz_srcptr keyStorePub(const KeyStore *ks, size_t i, mpz_t view);
+
+//Identity of the key set: FNV-1a over every key, little-endian. Never 0, so
+//that 0 can stand for no key set. keyFileWrite stores it in the header
+//(keySet), where state derived from the keys can be checked against it.
+uint64_t keyStoreId(const KeyStore *ks);
+
+//Key store file: an SFE container of kind SFE_KIND_KEY with two fields per
+//record (secKey, pubKey) in the SFE_FLAG_LIMBS layout and the record id
+//holding the slot. With SFE_FLAG_INDEXED the records are followed by the
+//index: `count` pairs of big-endian 64-bit (ID hash, slot), sorted by hash.
+//The header's keySet is keyStoreId of the stored keys.
+//The file is used through a read-only mapping, so a lookup only touches the
+//index pages it searches and the one record it finds.
+typedef struct {
+    SfeMap map;
+    const unsigned char *index;
+} KeyFile;
+
+//FNV-1a of a user ID, the key of the index
+uint64_t keyIdHash(const char *id);
+
+//Write ks with hashes[i] the ID hash of slot i; -1 on I/O errors or if two
+//IDs hash alike
+int keyFileWrite(const char *path, const KeyStore *ks, const uint64_t *hashes, uint64_t fingerprint);
+
+int keyFileOpen(KeyFile *kf, const char *path);
+void keyFileClose(KeyFile *kf);
+
+//Slot of the user with the given ID hash, -1 if there is none
+int64_t keyFileFind(const KeyFile *kf, uint64_t hash);
+
+//Keys of slot i, as sfeMapField
+mpz_srcptr keyFileSec(const KeyFile *kf, uint64_t i, mpz_t view, mpz_t scratch);
+mpz_srcptr keyFilePub(const KeyFile *kf, uint64_t i, mpz_t view, mpz_t scratch);
+
+#endif
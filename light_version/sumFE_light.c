@@ -1,10 +1,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
 #include "mini-gmp.h"
+#include "sumFE_arena.h"
+#include "sumFE_io.h"
+#include "sumFE_epoch.h"
+#include "sumFE_rng.h"
+#include "sumFE_mont.h"
+
+//Parameters compiled in as limb arrays, generated by sumFE_gentables
+#ifdef SUMFE_CONST_PARAMS
+#include "sumFE_params.h"
+
+_Static_assert(sizeof(mp_limb_t) * 8 == SFE_PARAM_LIMB_BITS, "sumFE_params.h was generated for another limb size");
+
+static const MontParams paramMod = { sfeParamP, SFE_PARAM_LIMBS, SFE_PARAM_PINV };
+static const MontFixedBase paramG = { &paramMod, sfeFixedG, SFE_FIXED_BITS, SFE_FIXED_WINDOWS };
+#endif
 
 #define NUM 2
 
+//Window of the run-time tables built by encryptBatch
+#define BATCH_WINDOW 4
+
+//Readings from which encryptBatch builds full-width tables for g and pk: a
+//table takes about four exponentiations to build and makes each of them
+//about four times cheaper
+#define BATCH_FIXED_MIN 8
+
 //Representation of a Ciphertext
 typedef struct {
     mpz_t firstcomp;   
@@ -20,35 +44,25 @@ typedef struct {
     unsigned long int plaintext;
 } Users;
 
-void random_number(mpz_t cnt, mpz_t p, mpz_t out) {
-    mpz_t result, tmp1, tmp2;
-    mpz_init(result);
-    mpz_init(tmp1);
-
-    srand(time(NULL));
-    mpz_sub(tmp1, p, cnt);
+//Secret key uniform in [0, p-1), the range of exponents of g
+int random_number(RngStream *rng, mpz_t p, mpz_t out) {
+    mpz_t order;
+    mpz_init_set(order, p);
+    mpz_sub_ui(order, order, 1);
 
-    unsigned long int v = rand() % 50;
-    mpz_init_set_ui(tmp2, v);
+    int ret = rngUniformMod(rng, out, order);
 
-    mpz_mul(result, tmp2, p);
-    mpz_add(result, result, cnt);
-    //mpz_mod(result, result, p);
-
-    //FILE *fp;
-    //fp = fopen("secKey.txt", "w+");
-    //mpz_out_str(fp, 0, result);
-
-    mpz_set(out, result);
-
-    mpz_clear(result);
-    mpz_clear(tmp1);
-    mpz_clear(tmp2);
+    mpz_clear(order);
+    return ret;
 }
 
-void genKeyPair(Users *U, mpz_t p, mpz_t g) {    
-    mpz_t cnt;
-    mpz_init_set_str(cnt, "2", 0);
+int genKeyPair(Users *U, mpz_t p, mpz_t g) {    
+    unsigned char seed[RNG_SEED_SIZE];
+    RngStream rng;
+
+    if (rngSystemSeed(seed) != 0)
+        return -1;
+    rngInit(&rng, seed, 0);
 
     //Initialise the parameters
     mpz_t sKey, pKey;
@@ -56,7 +70,7 @@ void genKeyPair(Users *U, mpz_t p, mpz_t g) {
     mpz_init(pKey);
 
     //Generate a random secret key based on p
-    random_number(cnt, p, sKey);
+    int ret = random_number(&rng, p, sKey);
 
     //Calculate the public key based on the secret key
     mpz_powm(pKey, g, sKey, p);
@@ -68,9 +82,19 @@ void genKeyPair(Users *U, mpz_t p, mpz_t g) {
     //Clear the temporal parameters from memory
     mpz_clear(sKey);
     mpz_clear(pKey);
+    rngClear(&rng);
+    memset(seed, 0, sizeof(seed));
+    return ret;
 }
 
-void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r) {
+void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, const EpochContext *ep) {
+
+    //The outputs outlive the arena epoch, so reserve them on the heap first
+    mpz_init2(C->firstcomp, mpz_sizeinbase(p, 2));
+    mpz_init2(C->secondcomp, mpz_sizeinbase(p, 2));
+
+    size_t mark = arenaEpochBegin();
+
     mpz_t res1, res2, tmp1, tmp2, tmp3;
     mpz_init(res1);
     mpz_init(res2);
@@ -79,12 +103,18 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r)
     mpz_init(tmp2);
     mpz_init(tmp3);
 
-    // (gˆr) % p
-    mpz_powm_ui(res1, g, r, p);
-    // tmp1 = pk ^r
-    mpz_pow_ui(tmp1, U->pubKey, r);
-    // tmp2 = g ^ msg
-    mpz_pow_ui(tmp2, g, U->plaintext);
+    // (gˆr) % p, shared by the whole epoch
+    mpz_set(res1, ep->firstcomp);
+    // tmp1 = (pk ^r) % p
+    mpz_powm(tmp1, U->pubKey, ep->r, p);
+    // tmp2 = (g ^ msg) % p
+#ifdef SUMFE_CONST_PARAMS
+    //Fixed-base table, powm for exponents it does not cover
+    if (montFixedPowUi(tmp2, &paramG, U->plaintext) != 0)
+        mpz_powm_ui(tmp2, g, U->plaintext, p);
+#else
+    mpz_powm_ui(tmp2, g, U->plaintext, p);
+#endif
     // tmp3 = tmp1 * tmp2
     mpz_mul(tmp3, tmp1, tmp2);
     // res2 = tmp3 % p
@@ -94,8 +124,8 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r)
     //mpz_mul(res3, res1, res2);
 
     //Copy results into struct
-    mpz_init_set(C->firstcomp, res1);
-    mpz_init_set(C->secondcomp, res2);
+    mpz_set(C->firstcomp, res1);
+    mpz_set(C->secondcomp, res2);
     //mpz_init_set(C[i].CT, res3);
 
     mpz_clear(res1);
@@ -103,33 +133,270 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r)
     mpz_clear(tmp1);
     mpz_clear(tmp2);
     mpz_clear(tmp3);
+
+    arenaEpochEnd(mark);
 }
 
+//Encrypt a device's buffered readings into one batch file, reading i for
+//epoch ep->id + i. Every epoch has its own r (see sumFE_epoch.h), derived
+//here from the epoch seed, so each reading costs two full-width
+//exponentiations, g^r and pk^r of its epoch, besides g^m and one modular
+//multiplication. The records carry g^r, which the aggregator cannot derive
+//without the seed. From BATCH_FIXED_MIN readings on both exponentiations
+//come from fixed-base tables for g and pk built here (about 1 MB), which
+//also serve g^m; smaller batches use mpz_powm, with g^m from a table for
+//the largest reading or the compiled-in one. Heapless builds build no
+//tables. Records are encrypted and written one at a time, memory does not
+//grow with the batch.
+int encryptBatch(const char *path, Users *U, const unsigned long int *readings, int num,
+                 mpz_t g, mpz_t p, const EpochContext *ep, const unsigned char *epochSeed, uint64_t fp) {
+    SfeHeader hdr;
+    epochCiphertextHeader(ep->id, &hdr, fp, 0);
+    hdr.flags |= SFE_FLAG_LIMBS;
+    hdr.count = num;
+
+    FILE *cp = fopen(path, "wb");
+    if (cp == NULL)
+        return -1;
+
+    mpz_t r, first, second;
+    mpz_init2(r, mpz_sizeinbase(p, 2));
+    mpz_init2(first, mpz_sizeinbase(p, 2));
+    mpz_init2(second, mpz_sizeinbase(p, 2));
+
+    //gTable serves g^m, grTable g^r and pkTable pk^r; powm for what they
+    //do not cover
+    const MontFixedBase *gTable = NULL, *grTable = NULL, *pkTable = NULL;
+#ifdef SUMFE_CONST_PARAMS
+    gTable = &paramG;
+    grTable = &paramG;
+#endif
+#ifndef SUMFE_NO_MALLOC
+    MontParams mod;
+    MontFixedBase gRun = { NULL, NULL, 0, 0, NULL };
+    MontFixedBase pkRun = { NULL, NULL, 0, 0, NULL };
+    int full = num >= BATCH_FIXED_MIN;
+    unsigned long int largest = 1;
+    unsigned expBits = 0;
+
+    if (full) {
+        expBits = (unsigned) mpz_sizeinbase(p, 2);
+    } else {
+        for (int i = 0; i < num; i++)
+            largest = readings[i] > largest ? readings[i] : largest;
+        for (; largest != 0; largest >>= 1)
+            expBits++;
+    }
+    if (montInit(&mod, p) == 0) {
+        if (full && montFixedInit(&pkRun, &mod, U->pubKey, BATCH_WINDOW, expBits) == 0)
+            pkTable = &pkRun;
+#ifdef SUMFE_CONST_PARAMS
+        //The compiled-in table only covers r if generated for full-width
+        //exponents (sumFE_gentables -e)
+        if (full && paramG.bits * paramG.windows < expBits
+            && montFixedInit(&gRun, &mod, g, BATCH_WINDOW, expBits) == 0)
+            grTable = &gRun;
+#else
+        if (montFixedInit(&gRun, &mod, g, BATCH_WINDOW, expBits) == 0) {
+            gTable = &gRun;
+            grTable = full ? &gRun : NULL;
+        }
+#endif
+    }
+#endif
+
+    int ret = sfeWriteHeader(cp, &hdr);
+    for (int i = 0; ret == 0 && i < num; i++) {
+        //r of epoch ep->id + i
+        ret = epochDeriveR(r, epochSeed, ep->id + (uint64_t) i, p);
+        if (ret != 0)
+            break;
+
+        size_t mark = arenaEpochBegin();
+
+        mpz_t gr, pkr, gm;
+        mpz_init(gr);
+        mpz_init(pkr);
+        mpz_init(gm);
+
+        // first = (g ^r) % p
+        if (grTable == NULL || montFixedPow(gr, grTable, r) != 0)
+            mpz_powm(gr, g, r, p);
+        mpz_set(first, gr);
+
+        // pkr = (pk ^r) % p
+        if (pkTable == NULL || montFixedPow(pkr, pkTable, r) != 0)
+            mpz_powm(pkr, U->pubKey, r, p);
+
+        // gm = (g ^ msg) % p
+        if (gTable == NULL || montFixedPowUi(gm, gTable, readings[i]) != 0)
+            mpz_powm_ui(gm, g, readings[i], p);
+        mpz_mul(gm, gm, pkr);
+        mpz_mod(second, gm, p);
+
+        mpz_clear(gr);
+        mpz_clear(pkr);
+        mpz_clear(gm);
+        arenaEpochEnd(mark);
+
+        ret = epochWriteCiphertextAt(cp, &hdr, 0, (uint32_t) i, first, second);
+    }
+
+    mpz_clear(r);
+    mpz_clear(first);
+    mpz_clear(second);
+#ifndef SUMFE_NO_MALLOC
+    montFixedClear(&gRun);
+    montFixedClear(&pkRun);
+#endif
+
+    if (fclose(cp) != 0)
+        ret = -1;
+    return ret;
+}
 
-int main() {
-    mpz_t p,g,q;
+//Release the parameters and the epoch; the compiled-in parameters are
+//read-only views and are not cleared
+static void clearParams(mpz_t p, mpz_t g, mpz_t q, EpochContext *ep) {
+#ifndef SUMFE_CONST_PARAMS
+    mpz_clear(p);
+    mpz_clear(g);
+    mpz_clear(q);
+#else
+    (void) p;
+    (void) g;
+    (void) q;
+#endif
+    epochClear(ep);
+}
 
-    unsigned long int r = 5;
+//  sumFE_light                 encrypt one test reading into ciphertext.bin
+//  sumFE_light reading ...     encrypt buffered readings, one per epoch
+//                              starting at the current one, into batch.bin
+int main(int argc, char **argv) {
+    mpz_t p,g,q;
 
+    uint64_t epoch = 0;
+
+    //Big-integer temporaries come from a per-thread arena
+    arenaInstall();
+    arenaThreadInit(0);
+
+    //Every epoch's r comes from the seed shared by the clients
+    unsigned char epochSeed[RNG_SEED_SIZE];
+    if (epochSeedLoad(EPOCH_SEED_FILE, epochSeed) != 0) {
+        fprintf(stderr, "Could not read %s\n", EPOCH_SEED_FILE);
+        return 1;
+    }
+
+    EpochContext ep;
+    int seeded;
+
+#ifdef SUMFE_CONST_PARAMS
+    //Read-only views of the constant limbs, nothing to parse
+    mpz_roinit_n(p, sfeParamP, SFE_PARAM_LIMBS);
+    mpz_roinit_n(g, sfeParamG, SFE_PARAM_LIMBS);
+    mpz_roinit_n(q, sfeParamQ, SFE_PARAM_Q_LIMBS);
+
+    //r spans p, so g^r only comes from the table if it was generated for
+    //full-width exponents (sumFE_gentables -e)
+    mpz_t r, gr;
+    mpz_init(r);
+    mpz_init(gr);
+    seeded = epochDeriveR(r, epochSeed, epoch, p) == 0;
+    if (montFixedPow(gr, &paramG, r) != 0)
+        mpz_powm(gr, g, r, p);
+    epochInitShared(&ep, epoch, r, gr);
+    mpz_clear(r);
+    mpz_clear(gr);
+#else
     mpz_init_set_str(p, "141103728801468755249503291901801300339454489134873273269161807133184957725631203791969744406992490029017308434294093310271973777802513443575042969796895750747614660497411432558300476234836462151925376765365205539666438199705555483194413832902302373511490858360959114097755447464088887287145428704637498873563", 0);
     mpz_init_set_str(g, "105861658449903670398842707812938888531601091401355008230876634024010937268870331311638117904636173888707058855182778532622385692236892785716421644114344195029162371175818169381366740838052666046929986716700970629216177653754852315554730008499152818656193522542478412787555437975470969140718764372166206582283", 0);
     mpz_init_set_str(q, "783294875021436409578654247252215361374348380322356315904524998417053527857380", 0);
 
-    Users U;
-    genKeyPair(&U, p, g);
+    seeded = epochInit(&ep, epoch, epochSeed, g, p) == 0;
+#endif
 
-    FILE *kp;
-    kp = fopen("keypair.txt", "w+");
-    mpz_out_str(kp, 0, U.secKey);
+    if (!seeded) {
+        fprintf(stderr, "Could not derive the randomness of epoch %llu\n", (unsigned long long) epoch);
+        clearParams(p, g, q, &ep);
+        return 1;
+    }
+
+    Users U;
+    if (genKeyPair(&U, p, g) != 0) {
+        fprintf(stderr, "Could not seed the key generator\n");
+        clearParams(p, g, q, &ep);
+        return 1;
+    }
+
+    uint64_t fp = sfeFingerprint(p, g);
+    SfeHeader hdr;
+
+    //The secret key is an exponent, store it reduced mod p-1 so it fits the field
+    mpz_t pm1;
+    mpz_init(pm1);
+    mpz_sub_ui(pm1, p, 1);
+    mpz_mod(U.secKey, U.secKey, pm1);
+    mpz_clear(pm1);
+
+    sfeInitHeader(&hdr, SFE_KIND_KEY, 1, fp, epoch);
+    if (sfeSave("keypair.bin", &hdr, &U.secKey) != 0)
+        fprintf(stderr, "Could not write keypair.bin\n");
+
+    if (argc > 1) {
+        int num = argc - 1;
+        int ret = 1;
+        unsigned long int *readings = malloc(num * sizeof(unsigned long int));
+        int valid = readings != NULL;
+
+        for (int i = 0; valid && i < num; i++) {
+            char *end;
+            readings[i] = strtoul(argv[i + 1], &end, 10);
+            if (*argv[i + 1] == '\0' || *end != '\0') {
+                fprintf(stderr, "Invalid reading %s\n", argv[i + 1]);
+                valid = 0;
+            }
+        }
+
+        if (valid) {
+            if (encryptBatch("batch.bin", &U, readings, num, g, p, &ep, epochSeed, fp) != 0)
+                fprintf(stderr, "Could not write batch.bin\n");
+            else {
+                printf("Encrypted %d readings into batch.bin\n", num);
+                ret = 0;
+            }
+        }
+
+        free(readings);
+        mpz_clear(U.secKey);
+        mpz_clear(U.pubKey);
+        clearParams(p, g, q, &ep);
+        return ret;
+    }
 
     U.plaintext = 1596;
 
     Ciphertext C;
-    HE_Encrypt(&C, &U, g, p, r);
-
-    FILE *cp;
-    cp = fopen("ciphertext.txt", "w+");
-    mpz_out_str(cp, 0, C.secondcomp);
+    HE_Encrypt(&C, &U, g, p, &ep);
+
+    //Both components go on the wire, the aggregator has no epoch seed to
+    //rebuild g^r from
+    epochCiphertextHeader(ep.id, &hdr, fp, 0);
+    hdr.count = 1;
+
+    FILE *cp = fopen("ciphertext.bin", "wb");
+    if (cp == NULL || sfeWriteHeader(cp, &hdr) != 0
+        || epochWriteCiphertext(cp, &hdr, 0, C.firstcomp, C.secondcomp) != 0)
+        fprintf(stderr, "Could not write ciphertext.bin\n");
+    if (cp != NULL)
+        fclose(cp);
+
+    mpz_clear(C.firstcomp);
+    mpz_clear(C.secondcomp);
+    mpz_clear(U.secKey);
+    mpz_clear(U.pubKey);
+    clearParams(p, g, q, &ep);
 
     return 1;
 }
\ No newline at end of file
@@ -1,7 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "mini-gmp.h"
+#include "sumFE_arena.h"
+#include "sumFE_io.h"
+#include "sumFE_epoch.h"
+#include "sumFE_rng.h"
+#include "sumFE_keys.h"
+#include "sumFE_master.h"
+#include "sumFE_window.h"
 
 #define NUM 5
 
@@ -20,44 +31,38 @@ typedef struct {
     unsigned long int plaintext;
 } Users;
 
-void random_number(mpz_t cnt, mpz_t p, mpz_t out) {
-    mpz_t result, tmp1, tmp2;
-    mpz_init(result);
-    mpz_init(tmp1);
+//Secret key uniform in [0, p-1), the range of exponents of g
+int random_number(RngStream *rng, mpz_t p, mpz_t out) {
+    mpz_t order;
+    mpz_init_set(order, p);
+    mpz_sub_ui(order, order, 1);
 
-    srand(time(NULL));
-    mpz_sub(tmp1, p, cnt);
+    int ret = rngUniformMod(rng, out, order);
 
-    unsigned long int v = rand() % 50;
-    mpz_init_set_ui(tmp2, v);
-
-    mpz_mul(result, tmp2, p);
-    mpz_add(result, result, cnt);
-    //mpz_mod(result, result, p);
-
-    //FILE *fp;
-    //fp = fopen("secKey.txt", "w+");
-    //mpz_out_str(fp, 0, result);
-
-    mpz_set(out, result);
-
-    mpz_clear(result);
-    mpz_clear(tmp1);
-    mpz_clear(tmp2);
+    mpz_clear(order);
+    return ret;
 }
 
-void genKeyPair(Users *U, int num, mpz_t p, mpz_t g) {    
-   mpz_t cnt;
-   mpz_init_set_str(cnt, "2", 0);
+int genKeyPair(Users *U, int num, mpz_t p, mpz_t g) {    
+    unsigned char seed[RNG_SEED_SIZE];
+    RngStream rng;
+    int ret = 0;
+
+    if (rngSystemSeed(seed) != 0)
+        return -1;
 
     for (int i = 0; i < num; i++) {
+        //One substream of the seed per user
+        rngInit(&rng, seed, (uint64_t) i);
+
         //Initialise the parameters
         mpz_t sKey, pKey;
         mpz_init(sKey);
         mpz_init(pKey);
 
         //Generate a random secret key based on p
-        random_number(cnt, p, sKey);
+        if (random_number(&rng, p, sKey) != 0)
+            ret = -1;
 
         //Calculate the public key based on the secret key
         mpz_powm(pKey, g, sKey, p);
@@ -70,11 +75,50 @@ void genKeyPair(Users *U, int num, mpz_t p, mpz_t g) {
         mpz_clear(sKey);
         mpz_clear(pKey);
     }
+
+    rngClear(&rng);
+    memset(seed, 0, sizeof(seed));
+    return ret;
 }
 
+//Take the users' keys by ID ("user<i>", as sumFE names them) from a mapped
+//key store; only the index and the records looked up are read. Returns -1
+//if a user is missing from the store.
+int loadKeyPairs(Users *U, int num, const KeyFile *kf) {
+    mpz_t view, scratch;
+    mpz_init(scratch);
+
+    int i;
+    for (i = 0; i < num; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "user%d", i);
+
+        int64_t slot = keyFileFind(kf, keyIdHash(id));
+        if (slot < 0)
+            break;
+        mpz_init_set(U[i].secKey, keyFileSec(kf, (uint64_t) slot, view, scratch));
+        mpz_init_set(U[i].pubKey, keyFilePub(kf, (uint64_t) slot, view, scratch));
+    }
+
+    mpz_clear(scratch);
+    if (i == num)
+        return 0;
+
+    while (i-- > 0) {
+        mpz_clear(U[i].secKey);
+        mpz_clear(U[i].pubKey);
+    }
+    return -1;
+}
 
-void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r, int num) {
+void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, const EpochContext *ep, int num) {
     for (int i = 0; i < num; i ++) {
+        //The outputs outlive the arena epoch, so reserve them on the heap first
+        mpz_init2(C[i].firstcomp, mpz_sizeinbase(p, 2));
+        mpz_init2(C[i].secondcomp, mpz_sizeinbase(p, 2));
+
+        size_t mark = arenaEpochBegin();
+
         mpz_t res1, res2, tmp1, tmp2, tmp3;
         mpz_init(res1);
         mpz_init(res2);
@@ -82,12 +126,12 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         mpz_init(tmp2);
         mpz_init(tmp3);
 
-        // (gˆr) % p
-        mpz_powm_ui(res1, g, r, p);
-        // tmp1 = pk ^r
-        mpz_pow_ui(tmp1, U[i].pubKey, r);
-        // tmp2 = g ^ msg
-        mpz_pow_ui(tmp2, g, U[i].plaintext);
+        // (gˆr) % p, shared by the whole epoch
+        mpz_set(res1, ep->firstcomp);
+        // tmp1 = (pk ^r) % p
+        mpz_powm(tmp1, U[i].pubKey, ep->r, p);
+        // tmp2 = (g ^ msg) % p
+        mpz_powm_ui(tmp2, g, U[i].plaintext, p);
         // tmp3 = tmp1 * tmp2
         mpz_mul(tmp3, tmp1, tmp2);
         // res2 = tmp3 % p
@@ -97,8 +141,8 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         //mpz_mul(res3, res1, res2);
 
         //Copy results into struct
-        mpz_init_set(C[i].firstcomp, res1);
-        mpz_init_set(C[i].secondcomp, res2);
+        mpz_set(C[i].firstcomp, res1);
+        mpz_set(C[i].secondcomp, res2);
         //mpz_init_set(C[i].CT, res3);
 
         mpz_clear(res1);
@@ -106,73 +150,562 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         mpz_clear(tmp1);
         mpz_clear(tmp2);
         mpz_clear(tmp3);
+
+        arenaEpochEnd(mark);
     }
 }
 
-void addCipher(int cnt, Ciphertext *out_cipher, Ciphertext *C, mpz_t g, mpz_t p, unsigned long int r) {
+void addCipher(int cnt, Ciphertext *out_cipher, Ciphertext *C, mpz_t p, const EpochContext *ep) {
     //mpz_powm_ui(finalCipher.firstcomp, g, r, p);
+    mpz_init2(out_cipher->firstcomp, mpz_sizeinbase(p, 2));
+    mpz_init2(out_cipher->secondcomp, mpz_sizeinbase(p, 2));
+
+    size_t mark = arenaEpochBegin();
+
     mpz_t res1, res2;
     mpz_init(res1);
     mpz_init(res2);
 
     //first component of the ciphertext. Same as all ciphertexts
-    mpz_powm_ui(res1, g, r, p);
+    mpz_set(res1, ep->firstcomp);
 
     mpz_set(res2, C[0].secondcomp);
 
+    //Keep the running product reduced so it stays one field wide
     for (int i = 1; i < cnt; i++){
         mpz_mul(res2, res2, C[i].secondcomp);
+        mpz_mod(res2, res2, p);
     }
 
     //copy results into the out_cipher
-    mpz_init_set(out_cipher->firstcomp, res1);
-    mpz_init_set(out_cipher->secondcomp, res2);
+    mpz_set(out_cipher->firstcomp, res1);
+    mpz_set(out_cipher->secondcomp, res2);
 
     mpz_clear(res1);
     mpz_clear(res2);
 
+    arenaEpochEnd(mark);
+
 }
 
-void addKeys(int cnt, Users *U, mpz_t msk){
-    mpz_t res;
-    mpz_init(res);
+//Bring the master key of the last run up to this run's members, users
+//0 .. num-1: users past the saved member count join, members past num leave,
+//all in one update. U holds the keys of whichever of the two is larger.
+int updateMembers(MasterKey *mk, Users *U, int num) {
+    uint64_t kept = mk->members < (uint64_t) num ? mk->members : (uint64_t) num;
+    size_t changed = (size_t) ((mk->members < (uint64_t) num ? (uint64_t) num : mk->members) - kept);
+
+    mpz_srcptr *keys = malloc((changed ? changed : 1) * sizeof(mpz_srcptr));
+    if (keys == NULL)
+        return -1;
+    for (size_t i = 0; i < changed; i++)
+        keys[i] = U[kept + i].secKey;
+
+    int ret;
+    if (mk->members < (uint64_t) num)
+        ret = masterUpdate(mk, keys, changed, NULL, 0);
+    else
+        ret = masterUpdate(mk, NULL, 0, keys, changed);
+
+    free(keys);
+    return ret;
+}
 
-    mpz_set(res, U[0].secKey);
 
-    for (int i = 1; i < cnt; i++){
-        mpz_add(res, res, U[i].secKey);
+//Write the aggregate as a single record of epoch, with g^r for the decryptor
+int writeAggregate(const char *path, Ciphertext *C, uint64_t epoch, uint64_t fp) {
+    SfeHeader hdr;
+    epochCiphertextHeader(epoch, &hdr, fp, 0);
+    hdr.count = 1;
+
+    FILE *cp = fopen(path, "wb");
+    if (cp == NULL)
+        return -1;
+
+    int ret = sfeWriteHeader(cp, &hdr);
+    if (ret == 0)
+        ret = epochWriteCiphertext(cp, &hdr, 0, C->firstcomp, C->secondcomp);
+    if (fclose(cp) != 0)
+        ret = -1;
+    return ret;
+}
+
+//Write the users' ciphertexts as one batch file in the limb layout, ready to
+//be mapped by aggregateDirectory. The records carry g^r, since the
+//aggregator does not hold the epoch seed.
+int writeBatch(const char *path, Ciphertext *C, int num, const EpochContext *ep, uint64_t fp) {
+    SfeHeader hdr;
+    epochCiphertextHeader(ep->id, &hdr, fp, 0);
+    hdr.flags |= SFE_FLAG_LIMBS;
+    hdr.count = num;
+
+    FILE *cp = fopen(path, "wb");
+    if (cp == NULL)
+        return -1;
+
+    int ret = sfeWriteHeader(cp, &hdr);
+    for (int i = 0; ret == 0 && i < num; i++)
+        ret = epochWriteCiphertext(cp, &hdr, i, C[i].firstcomp, C[i].secondcomp);
+    if (fclose(cp) != 0)
+        ret = -1;
+    return ret;
+}
+
+//Running products of the epochs first .. first + span - 1, one per epoch, so
+//the inputs are read once whatever the number of epochs. firsts holds the
+//g^r the epoch's records carry, 1 until one is folded, so that an empty epoch
+//aggregates to (1, 1), a ciphertext of 0.
+typedef struct {
+    uint64_t first;
+    uint64_t span;
+    mpz_t *acc;
+    mpz_t *firsts;
+    long *counts;
+} EpochFold;
+
+static int foldInit(EpochFold *ef, uint64_t first, uint64_t span) {
+    ef->first = first;
+    ef->span = span;
+    ef->acc = malloc((span ? span : 1) * sizeof(mpz_t));
+    ef->firsts = malloc((span ? span : 1) * sizeof(mpz_t));
+    ef->counts = calloc(span ? span : 1, sizeof(long));
+    if (ef->acc == NULL || ef->firsts == NULL || ef->counts == NULL) {
+        free(ef->acc);
+        free(ef->firsts);
+        free(ef->counts);
+        return -1;
+    }
+    for (uint64_t i = 0; i < span; i++) {
+        mpz_init_set_ui(ef->acc[i], 1);
+        mpz_init_set_ui(ef->firsts[i], 1);
+    }
+    return 0;
+}
+
+static void foldClear(EpochFold *ef) {
+    for (uint64_t i = 0; i < ef->span; i++) {
+        mpz_clear(ef->acc[i]);
+        mpz_clear(ef->firsts[i]);
+    }
+    free(ef->acc);
+    free(ef->firsts);
+    free(ef->counts);
+}
+
+//Multiply the ciphertext (first, x) of epoch e into its epoch's product; 1 if
+//the epoch is one of those folded, 0 if the record is skipped, -1 if its g^r
+//is not the one of the epoch's other records
+static int foldRecord(EpochFold *ef, uint64_t e, const mpz_t first, const mpz_t x, mpz_t p) {
+    if (e < ef->first || e - ef->first >= ef->span)
+        return 0;
+
+    uint64_t i = e - ef->first;
+    if (ef->counts[i] == 0) {
+        mpz_set(ef->firsts[i], first);
+    } else if (mpz_cmp(ef->firsts[i], first) != 0) {
+        fprintf(stderr, "Ciphertexts of epoch %llu differ in g^r\n", (unsigned long long) e);
+        return -1;
+    }
+
+    mpz_ptr acc = ef->acc[i];
+    mpz_mul(acc, acc, x);
+    mpz_mod(acc, acc, p);
+    ef->counts[i]++;
+    return 1;
+}
+
+//Only ciphertexts with both components can be aggregated: without the epoch
+//seed the aggregator cannot rebuild g^r of compact ones
+static int foldCheckHeader(const SfeHeader *h, const char *name, uint64_t fp) {
+    if (epochCheckHeader(h, fp) != 0) {
+        fprintf(stderr, "Skipping %s: not a ciphertext batch for these parameters\n", name);
+        return -1;
+    }
+    if (h->flags & SFE_FLAG_COMPACT) {
+        fprintf(stderr, "Skipping %s: compact ciphertexts do not carry g^r\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+//Fold the ciphertexts of one mapped batch file into their epochs. The records
+//are multiplied in place, without parsing or copying them into mpz_t.
+//Returns the number of ciphertexts folded, -1 if the file is not a batch.
+static long foldMapped(const char *path, EpochFold *ef, mpz_t p, uint64_t fp) {
+    SfeMap m;
+    if (sfeMapOpen(&m, path) != 0)
+        return -1;
+    if (foldCheckHeader(&m.hdr, path, fp) != 0) {
+        sfeMapClose(&m);
+        return 0;
+    }
+
+    mpz_t view, scratch, firstView, firstScratch;
+    mpz_init(scratch);
+    mpz_init(firstScratch);
+    long cnt = 0;
+
+    for (uint64_t i = 0; i < m.count; i++) {
+        uint32_t offset;
+        sfeMapId(&m, i, NULL, &offset);
+        if (offset == SFE_OFFSET_NONE)
+            continue;
+
+        int n = foldRecord(ef, m.hdr.epoch + offset, sfeMapField(&m, i, 0, firstView, firstScratch),
+                           sfeMapField(&m, i, 1, view, scratch), p);
+        if (n < 0) {
+            cnt = -1;
+            break;
+        }
+        cnt += n;
+    }
+
+    mpz_clear(scratch);
+    mpz_clear(firstScratch);
+    sfeMapClose(&m);
+    return cnt;
+}
+
+//Fold the ciphertexts of a stream that cannot be mapped (stdin, a pipe) into
+//their epochs, one record at a time. Several batches may follow each other.
+//Returns the number of ciphertexts folded, -1 on a read error.
+static long foldStream(FILE *in, const char *name, EpochFold *ef, mpz_t p, uint64_t fp) {
+    SfeHeader h;
+    long cnt = 0;
+
+    mpz_t first, x;
+    mpz_init(first);
+    mpz_init(x);
+
+    while (sfeReadHeader(in, &h) == 0) {
+        if (foldCheckHeader(&h, name, fp) != 0)
+            break;
+
+        for (uint64_t i = 0; h.count == 0 || i < h.count; i++) {
+            uint32_t offset;
+            if (sfeReadId(in, NULL, &offset) != 0) {
+                //A batch of unknown length ends at EOF
+                if (h.count == 0 && feof(in))
+                    break;
+                cnt = -1;
+                goto done;
+            }
+
+            if (sfeReadField(in, &h, first) != 0 || sfeReadField(in, &h, x) != 0) {
+                cnt = -1;
+                goto done;
+            }
+            if (offset == SFE_OFFSET_NONE)
+                continue;
+
+            int n = foldRecord(ef, h.epoch + offset, first, x, p);
+            if (n < 0) {
+                cnt = -1;
+                goto done;
+            }
+            cnt += n;
+        }
+    }
+    if (ferror(in))
+        cnt = -1;
+
+done:
+    mpz_clear(first);
+    mpz_clear(x);
+    return cnt;
+}
+
+//Fold every batch file of a directory. Files that cannot be read are
+//reported, and make the whole directory count as unreadable.
+static long foldDirectory(const char *dir, EpochFold *ef, mpz_t p, uint64_t fp) {
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return -1;
+
+    long cnt = 0;
+    int failed = 0;
+    struct dirent *de;
+    char path[4096];
+
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+
+        long n = foldMapped(path, ef, p, fp);
+        if (n < 0) {
+            fprintf(stderr, "Could not read %s\n", path);
+            failed = 1;
+        } else {
+            cnt += n;
+        }
+    }
+    closedir(d);
+    return failed ? -1 : cnt;
+}
+
+//Fold any mix of directories, batch files and streams ("-" is stdin) into
+//the epochs of ef. Every input is read once. Returns the number of
+//ciphertexts folded, -1 if any input could not be read (each is reported).
+static long foldInputs(int num, char **inputs, EpochFold *ef, mpz_t p, uint64_t fp) {
+    long cnt = 0;
+    int failed = 0;
+    for (int i = 0; i < num; i++) {
+        struct stat st;
+        long n;
+
+        if (strcmp(inputs[i], "-") == 0) {
+            n = foldStream(stdin, "stdin", ef, p, fp);
+        } else if (stat(inputs[i], &st) != 0) {
+            n = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            n = foldDirectory(inputs[i], ef, p, fp);
+        } else if (S_ISREG(st.st_mode)) {
+            n = foldMapped(inputs[i], ef, p, fp);
+        } else {
+            FILE *in = fopen(inputs[i], "rb");
+            n = in != NULL ? foldStream(in, inputs[i], ef, p, fp) : -1;
+            if (in != NULL)
+                fclose(in);
+        }
+
+        if (n < 0) {
+            fprintf(stderr, "Could not read %s\n", inputs[i]);
+            failed = 1;
+        } else {
+            cnt += n;
+        }
+    }
+    return failed ? -1 : cnt;
+}
+
+//Fold the epoch's ciphertexts of the inputs into out_cipher. Only the
+//running product is kept, so memory does not depend on the number of
+//clients; g^r is taken from the records. Returns the number of ciphertexts
+//folded, -1 if out of memory or an input could not be read (out_cipher is
+//then left uninitialised).
+long aggregateInputs(int num, char **inputs, Ciphertext *out_cipher, mpz_t p, uint64_t epoch, uint64_t fp) {
+    EpochFold ef;
+    if (foldInit(&ef, epoch, 1) != 0)
+        return -1;
+
+    long cnt = foldInputs(num, inputs, &ef, p, fp);
+    if (cnt >= 0) {
+        mpz_init_set(out_cipher->firstcomp, ef.firsts[0]);
+        mpz_init_set(out_cipher->secondcomp, ef.acc[0]);
     }
 
-    mpz_init_set(msk, res);
-    mpz_clear(res);
+    foldClear(&ef);
+    return cnt;
 }
 
+//Aggregate epochs epoch .. epoch + span - 1 of the inputs and write, for each,
+//the rolling aggregate of the last `window` epochs as one record at its epoch
+//offset. The inputs are read once, into one running product per epoch, so
+//stdin works too; the epochs then go through the window in order. The epochs
+//of a window have different r, so a record's firstcomp is the product of
+//their g^r; it decrypts with msk while the users stay the same. Returns -1 on
+//a write error, or if an input could not be read, in which case nothing is
+//written.
+int aggregateRolling(int num, char **inputs, const char *path, uint64_t epoch, uint64_t span, size_t window,
+                     mpz_t p, uint64_t fp) {
+    EpochFold ef;
+    if (foldInit(&ef, epoch, span) != 0)
+        return -1;
+
+    SlidingWindow win;
+    if (windowInit(&win, window, p) != 0) {
+        foldClear(&ef);
+        return -1;
+    }
+
+    //Nothing is written unless every input was read
+    if (foldInputs(num, inputs, &ef, p, fp) < 0) {
+        windowClear(&win);
+        foldClear(&ef);
+        return -1;
+    }
+
+    SfeHeader hdr;
+    epochCiphertextHeader(epoch, &hdr, fp, 0);
+    hdr.count = span;
+
+    FILE *cp = fopen(path, "wb");
+    int ret = cp != NULL ? sfeWriteHeader(cp, &hdr) : -1;
+
+    for (uint64_t i = 0; ret == 0 && i < span; i++) {
+        printf("Aggregated %ld ciphertexts of epoch %llu\n", ef.counts[i], (unsigned long long) (epoch + i));
 
-int main() {
+        ret = windowPush(&win, ef.firsts[i], ef.acc[i]);
+        if (ret == 0)
+            ret = epochWriteCiphertextAt(cp, &hdr, 0, (uint32_t) i, win.first, win.prod);
+    }
+
+    if (cp != NULL && fclose(cp) != 0)
+        ret = -1;
+    windowClear(&win);
+    foldClear(&ef);
+    return ret;
+}
+
+//  sumFE_light_sum [-u users]                 simulate users (NUM by default) and
+//                                             aggregate them, updating master.bin
+//  sumFE_light_sum [-e epoch] [-o out] input ...
+//                                             aggregate client batches; an input is a
+//                                             batch file, a directory of them, or "-"
+//  sumFE_light_sum [-e epoch] [-o out] -n epochs [-w window] input ...
+//                                             rolling aggregates of `window` epochs
+//                                             (all of them by default) for each of
+//                                             `epochs` epochs from epoch on
+int main(int argc, char **argv) {
     mpz_t p,g,q;
 
-    unsigned long int r = 5;
+    uint64_t epoch = 0;
+    const char *out = "ciphertext.bin";
+    uint64_t span = 0;
+    size_t window = 0;
+    int users = NUM;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:o:n:w:u:")) != -1) {
+        switch (opt) {
+        case 'e': epoch = strtoull(optarg, NULL, 0); break;
+        case 'o': out = optarg; break;
+        case 'n': span = strtoull(optarg, NULL, 0); break;
+        case 'w': window = (size_t) strtoull(optarg, NULL, 0); break;
+        case 'u': users = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-e epoch] [-o out.bin] [-u users] [-n epochs [-w window]] [input ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (users <= 0) {
+        fprintf(stderr, "The number of users must be positive\n");
+        return 1;
+    }
+
+    //Big-integer temporaries come from a per-thread arena
+    arenaInstall();
+    arenaThreadInit(0);
 
     mpz_init_set_str(p, "141103728801468755249503291901801300339454489134873273269161807133184957725631203791969744406992490029017308434294093310271973777802513443575042969796895750747614660497411432558300476234836462151925376765365205539666438199705555483194413832902302373511490858360959114097755447464088887287145428704637498873563", 0);
     mpz_init_set_str(g, "105861658449903670398842707812938888531601091401355008230876634024010937268870331311638117904636173888707058855182778532622385692236892785716421644114344195029162371175818169381366740838052666046929986716700970629216177653754852315554730008499152818656193522542478412787555437975470969140718764372166206582283", 0);
     mpz_init_set_str(q, "783294875021436409578654247252215361374348380322356315904524998417053527857380", 0);
 
-    Users U[NUM];
-    genKeyPair(U, NUM, p, g);
+    uint64_t fp = sfeFingerprint(p, g);
+
+    //Aggregating client batches only needs the g^r they carry, the epoch seed
+    //stays with the clients
+
+    //Rolling aggregates over a run of epochs
+    if (optind < argc && span > 0) {
+        int ret = aggregateRolling(argc - optind, argv + optind, out, epoch, span, window > 0 ? window : span, p, fp);
+        if (ret != 0)
+            fprintf(stderr, "Could not aggregate the inputs into %s\n", out);
+        return ret == 0 ? 0 : 1;
+    }
+
+    //Aggregate client batches instead of simulated users
+    if (optind < argc) {
+        Ciphertext t_cipher;
+        long cnt = aggregateInputs(argc - optind, argv + optind, &t_cipher, p, epoch, fp);
+        if (cnt < 0) {
+            fprintf(stderr, "Could not aggregate the inputs, not writing %s\n", out);
+            return 1;
+        }
+        printf("Aggregated %ld ciphertexts of epoch %llu\n", cnt, (unsigned long long) epoch);
+
+        int ret = writeAggregate(out, &t_cipher, epoch, fp);
+        if (ret != 0)
+            fprintf(stderr, "Could not write %s\n", out);
+        mpz_clear(t_cipher.firstcomp);
+        mpz_clear(t_cipher.secondcomp);
+        return ret == 0 ? 0 : 1;
+    }
+
+    //The simulated users are clients: their r comes from the epoch seed
+    unsigned char epochSeed[RNG_SEED_SIZE];
+    EpochContext ep;
+    if (epochSeedLoad(EPOCH_SEED_FILE, epochSeed) != 0) {
+        fprintf(stderr, "Could not read %s\n", EPOCH_SEED_FILE);
+        return 1;
+    }
+    if (epochInit(&ep, epoch, epochSeed, g, p) != 0) {
+        fprintf(stderr, "Could not derive the randomness of epoch %llu\n", (unsigned long long) epoch);
+        epochClear(&ep);
+        return 1;
+    }
+
+    //The key authority's state from the last run, kept apart from the
+    //keypair.bin clients and aggregators exchange
+    MasterKey mk;
+    masterInit(&mk, p);
+    struct stat st;
+    if (masterLoad(&mk, MASTER_STATE_FILE, fp) != 0 && stat(MASTER_STATE_FILE, &st) == 0) {
+        fprintf(stderr, "%s is not a master key state for these parameters\n", MASTER_STATE_FILE);
+        return 1;
+    }
+
+    //Members are users 0 .. members-1 of sumFE's key store. sumFE writes a
+    //new store, with new keys, on every run, so a state built on another one
+    //(or on generated keys) is rebuilt: everyone joins a new master key.
+    KeyFile kf;
+    int stored = keyFileOpen(&kf, "keystore.bin") == 0;
+    if (stored && kf.map.hdr.fingerprint != fp) {
+        keyFileClose(&kf);
+        stored = 0;
+    }
+    if (!stored || kf.map.hdr.keySet != mk.keySet) {
+        mpz_set_ui(mk.msk, 0);
+        mk.members = 0;
+    }
+
+    //The keys of members leaving are looked up too
+    int total = mk.members > (uint64_t) users ? (int) mk.members : users;
+    Users *U = malloc(total * sizeof(Users));
+    Ciphertext *cipher = malloc(users * sizeof(Ciphertext));
+    if (U == NULL || cipher == NULL) {
+        fprintf(stderr, "Could not allocate %d users\n", total);
+        return 1;
+    }
+    if (stored && loadKeyPairs(U, total, &kf) != 0) {
+        fprintf(stderr, "keystore.bin does not hold %d users, generating keys\n", total);
+        keyFileClose(&kf);
+        stored = 0;
+        mpz_set_ui(mk.msk, 0);
+        mk.members = 0;
+    }
+    if (stored) {
+        mk.keySet = kf.map.hdr.keySet;
+        keyFileClose(&kf);
+    } else {
+        mk.keySet = 0;
+        if (genKeyPair(U, users, p, g) != 0) {
+            fprintf(stderr, "Could not seed the key generator\n");
+            return 1;
+        }
+    }
+
+    uint64_t members = mk.members;
+    if (updateMembers(&mk, U, users) != 0) {
+        fprintf(stderr, "Could not update the master key\n");
+        return 1;
+    }
+    printf("Master key of %llu members, %llu before\n", (unsigned long long) mk.members, (unsigned long long) members);
 
     srand(time(NULL));   // Initialization, should only be called once.
 
     //Generate random values for test purposes
-    for (int i = 0; i < NUM; i ++) {
+    for (int i = 0; i < users; i ++) {
         U[i].plaintext = rand() % 1500; 
         //printf("%ld\n", U[i].plaintext);
     }
     
     unsigned long int sum = U[0].plaintext;
-     for (int i = 1; i < NUM; i ++) {
+     for (int i = 1; i < users; i ++) {
         sum = sum + U[i].plaintext; 
     }
-    printf("Total sum of %d plaintext values is = %ld\n", NUM, sum);
+    printf("Total sum of %d plaintext values is = %ld\n", users, sum);
 
     /*
     FILE *kp;
@@ -180,23 +713,31 @@ int main() {
     mpz_out_str(kp, 0, U.secKey);
     */
 
-    mpz_t msk;
-    addKeys(NUM, U, msk);
+    //gmp_printf("MSK: %Zd\n", mk.msk);
 
-    FILE *kp;
-    kp = fopen("keypair.txt", "w+");
-    mpz_out_str(kp, 0, msk);
-    //gmp_printf("MSK: %Zd\n", msk);
+    //The state for the next run, and the decryption key for this one
+    SfeHeader khdr;
+    sfeInitHeader(&khdr, SFE_KIND_KEY, 1, fp, epoch);
+    if (masterSave(&mk, MASTER_STATE_FILE, fp, epoch) != 0)
+        fprintf(stderr, "Could not write %s\n", MASTER_STATE_FILE);
+    if (sfeSave("keypair.bin", &khdr, &mk.msk) != 0)
+        fprintf(stderr, "Could not write keypair.bin\n");
+
+    HE_Encrypt(cipher, U, g, p, &ep, users);
 
-    Ciphertext cipher[NUM];
-    HE_Encrypt(cipher, U, g, p, r, NUM);
+    if (writeBatch("batch.bin", cipher, users, &ep, fp) != 0)
+        fprintf(stderr, "Could not write batch.bin\n");
 
     Ciphertext t_cipher;
-    addCipher(NUM, &t_cipher, cipher, g, p, r);
+    addCipher(users, &t_cipher, cipher, p, &ep);
+
+    if (writeAggregate(out, &t_cipher, ep.id, fp) != 0)
+        fprintf(stderr, "Could not write %s\n", out);
 
-    FILE *cp;
-    cp = fopen("ciphertext.txt", "w+");
-    mpz_out_str(cp, 0, t_cipher.secondcomp);
+    free(cipher);
+    free(U);
+    masterClear(&mk);
+    epochClear(&ep);
 
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <stdio.h>
+
+#include "sumFE_io.h"
+#include "sumFE_master.h"
+
+void masterInit(MasterKey *mk, const mpz_t p) {
+    mpz_init2(mk->msk, mpz_sizeinbase(p, 2));
+    mpz_init_set(mk->order, p);
+    mpz_sub_ui(mk->order, mk->order, 1);
+    mk->members = 0;
+    mk->keySet = 0;
+}
+
+void masterClear(MasterKey *mk) {
+    mpz_clear(mk->msk);
+    mpz_clear(mk->order);
+    mk->members = 0;
+}
+
+void masterAdd(MasterKey *mk, const mpz_t secKey) {
+    mpz_add(mk->msk, mk->msk, secKey);
+    if (mpz_cmp(mk->msk, mk->order) >= 0)
+        mpz_sub(mk->msk, mk->msk, mk->order);
+
+    //A key that was not reduced mod p-1 needs a full reduction
+    if (mpz_cmp(mk->msk, mk->order) >= 0)
+        mpz_mod(mk->msk, mk->msk, mk->order);
+    mk->members++;
+}
+
+int masterRemove(MasterKey *mk, const mpz_t secKey) {
+    if (mk->members == 0)
+        return -1;
+
+    mpz_sub(mk->msk, mk->msk, secKey);
+    if (mpz_sgn(mk->msk) < 0)
+        mpz_add(mk->msk, mk->msk, mk->order);
+    if (mpz_sgn(mk->msk) < 0)
+        mpz_mod(mk->msk, mk->msk, mk->order);
+    mk->members--;
+    return 0;
+}
+
+int masterUpdate(MasterKey *mk, const mpz_srcptr *joins, size_t numJoins, const mpz_srcptr *leaves, size_t numLeaves) {
+    if (numLeaves > mk->members + numJoins)
+        return -1;
+
+    //Accumulate the whole batch unreduced, then fold it in once
+    mpz_t delta;
+    mpz_init(delta);
+    for (size_t i = 0; i < numJoins; i++)
+        mpz_add(delta, delta, joins[i]);
+    for (size_t i = 0; i < numLeaves; i++)
+        mpz_sub(delta, delta, leaves[i]);
+
+    mpz_add(mk->msk, mk->msk, delta);
+    mpz_mod(mk->msk, mk->msk, mk->order);
+    mpz_clear(delta);
+
+    mk->members = mk->members + numJoins - numLeaves;
+    return 0;
+}
+
+int masterSave(const MasterKey *mk, const char *path, uint64_t fingerprint, uint64_t epoch) {
+    SfeHeader hdr;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    sfeInitHeader(&hdr, SFE_KIND_MASTER, 1, fingerprint, epoch);
+    hdr.count = 1;
+    hdr.keySet = mk->keySet;
+
+    int ret = sfeWriteHeader(fp, &hdr);
+    if (ret == 0)
+        ret = sfeWriteId(fp, (uint32_t) mk->members, 0);
+    if (ret == 0)
+        ret = sfeWriteField(fp, &hdr, mk->msk);
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+int masterLoad(MasterKey *mk, const char *path, uint64_t fingerprint) {
+    SfeHeader hdr;
+    uint32_t members;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    int ret = sfeReadHeader(fp, &hdr);
+    if (ret == 0 && (hdr.kind != SFE_KIND_MASTER || hdr.fields != 1 || hdr.fingerprint != fingerprint))
+        ret = -1;
+    if (ret == 0)
+        ret = sfeReadId(fp, &members, NULL);
+    if (ret == 0)
+        ret = sfeReadField(fp, &hdr, mk->msk);
+    fclose(fp);
+
+    if (ret != 0)
+        return -1;
+    mpz_mod(mk->msk, mk->msk, mk->order);
+    mk->members = members;
+    mk->keySet = hdr.keySet;
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SUMFE_MASTER_H
+#define SUMFE_MASTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Master secret key kept up to date as users join and leave.
+//
+//msk is the sum of the members' secret keys. It is only ever used as an
+//exponent of g^r, so it is kept reduced mod p-1: a join or a leave is one
+//addition or subtraction and at most one correction, and a batch of them
+//costs a single reduction, whatever the number of members.
+typedef struct {
+    mpz_t msk;
+    mpz_t order;                //p-1
+    uint64_t members;
+    uint64_t keySet;            //key store the members' keys are in, 0 if none
+} MasterKey;
+
+//Where the key authority keeps its state between runs
+#define MASTER_STATE_FILE "master.bin"
+
+//Empty master key for the modulus p
+void masterInit(MasterKey *mk, const mpz_t p);
+void masterClear(MasterKey *mk);
+
+//One user joins or leaves; masterRemove returns -1 if there is no member
+//left to remove
+void masterAdd(MasterKey *mk, const mpz_t secKey);
+int masterRemove(MasterKey *mk, const mpz_t secKey);
+
+//Apply a batch of joins and leaves with a single reduction; -1 (and nothing
+//applied) if more users leave than there are members
+int masterUpdate(MasterKey *mk, const mpz_srcptr *joins, size_t numJoins, const mpz_srcptr *leaves, size_t numLeaves);
+
+//The state is saved in a container of its own kind (SFE_KIND_MASTER), not
+//in a key file: one record holding msk, with the member count in the record
+//id and keySet in the header. Both return 0 on success.
+int masterSave(const MasterKey *mk, const char *path, uint64_t fingerprint, uint64_t epoch);
+
+//mk must have been initialised for the same p; -1 if the file cannot be
+//read, is not a master key state (a keypair.bin, say) or does not match the
+//fingerprint
+int masterLoad(MasterKey *mk, const char *path, uint64_t fingerprint);
+
+#endif
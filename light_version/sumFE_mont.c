@@ -0,0 +1,309 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumFE_mont.h"
+
+//{rp, n} = {tp, 2n} / R mod p, fully reduced. The carry of each step is
+//parked in the limb that step cleared and added back at the end.
+static void montRedc(mp_ptr rp, mp_ptr tp, const MontParams *m) {
+    mp_size_t n = m->n;
+
+    for (mp_size_t j = 0; j < n; j++)
+        tp[j] = mpn_addmul_1(tp + j, m->p, n, tp[j] * m->pinv);
+
+    mp_limb_t cy = mpn_add_n(rp, tp + n, tp, n);
+    if (cy != 0 || mpn_cmp(rp, m->p, n) >= 0)
+        mpn_sub_n(rp, rp, m->p, n);
+}
+
+//{tp, 2n} = {ap, n} * {bp, n}, schoolbook. mpn_mul_n/mpn_sqr would switch to
+//Karatsuba at these sizes, whose scratch mini-gmp takes from the heap.
+static void mulBasecase(mp_ptr tp, mp_srcptr ap, mp_srcptr bp, mp_size_t n) {
+    tp[n] = mpn_mul_1(tp, ap, n, bp[0]);
+    for (mp_size_t j = 1; j < n; j++)
+        tp[n + j] = mpn_addmul_1(tp + j, ap, n, bp[j]);
+}
+
+void montMul(mp_ptr rp, mp_srcptr ap, mp_srcptr bp, const MontParams *m) {
+    mp_limb_t tp[2 * MONT_MAX_LIMBS];
+
+    mulBasecase(tp, ap, bp, m->n);
+    montRedc(rp, tp, m);
+}
+
+int montInit(MontParams *m, const mpz_t p) {
+    mp_size_t n = (mp_size_t) mpz_size(p);
+
+    if (n == 0 || n > MONT_MAX_LIMBS || mpz_even_p(p))
+        return -1;
+
+    //Newton iteration, p odd is its own inverse mod 8
+    mp_limb_t p0 = mpz_getlimbn(p, 0), inv = p0;
+    for (unsigned bits = 3; bits < sizeof(mp_limb_t) * CHAR_BIT; bits *= 2)
+        inv *= 2 - p0 * inv;
+
+    m->p = mpz_limbs_read(p);
+    m->n = n;
+    m->pinv = -inv;
+    return 0;
+}
+
+//{rp, n} = x * R mod p
+static void montTo(mp_ptr rp, const mpz_t x, const MontParams *m) {
+    mpz_t t, view;
+
+    mpz_init(t);
+    mpz_mul_2exp(t, x, (mp_bitcnt_t) m->n * sizeof(mp_limb_t) * CHAR_BIT);
+    mpz_mod(t, t, mpz_roinit_n(view, m->p, m->n));
+
+    size_t tn = mpz_size(t);
+    memcpy(rp, mpz_limbs_read(t), tn * sizeof(mp_limb_t));
+    memset(rp + tn, 0, (m->n - tn) * sizeof(mp_limb_t));
+    mpz_clear(t);
+}
+
+//r = {ap, n} / R mod p, leaving Montgomery form: REDC of the value itself
+//divides out R. ap is clobbered.
+static void montFrom(mpz_t r, mp_ptr ap, const MontParams *m) {
+    mp_limb_t tp[2 * MONT_MAX_LIMBS];
+    mp_size_t n = m->n;
+
+    memcpy(tp, ap, n * sizeof(mp_limb_t));
+    memset(tp + n, 0, n * sizeof(mp_limb_t));
+    montRedc(ap, tp, m);
+
+    mpz_t view;
+    mpz_set(r, mpz_roinit_n(view, ap, n));
+}
+
+int montFixedInit(MontFixedBase *fb, const MontParams *m, const mpz_t g, unsigned bits, unsigned expBits) {
+    mp_size_t n = m->n;
+    size_t entries = ((size_t) 1 << bits) - 1;
+
+    fb->mod = m;
+    fb->bits = bits;
+    fb->windows = (expBits + bits - 1) / bits;
+    fb->owned = malloc(fb->windows * entries * n * sizeof(mp_limb_t));
+    fb->table = fb->owned;
+    if (fb->owned == NULL)
+        return -1;
+
+    //base = g^(2^(bits*j)) in Montgomery form, entry d of window j = base^d
+    mp_limb_t base[MONT_MAX_LIMBS];
+    montTo(base, g, m);
+
+    for (unsigned j = 0; j < fb->windows; j++) {
+        mp_ptr w = fb->owned + (size_t) j * entries * n;
+
+        memcpy(w, base, n * sizeof(mp_limb_t));
+        for (size_t d = 1; d < entries; d++)
+            montMul(w + d * n, w + (d - 1) * n, base, m);
+
+        for (unsigned k = 0; k < bits; k++)
+            montMul(base, base, base, m);
+    }
+    return 0;
+}
+
+void montFixedClear(MontFixedBase *fb) {
+    free(fb->owned);
+    fb->owned = NULL;
+    fb->table = NULL;
+}
+
+//Digit j of the exponent {ep, en}: bits [bits*j, bits*(j+1))
+static unsigned long int expDigit(mp_srcptr ep, mp_size_t en, size_t pos, unsigned bits) {
+    const unsigned limbBits = sizeof(mp_limb_t) * CHAR_BIT;
+    size_t i = pos / limbBits;
+    unsigned shift = pos % limbBits;
+
+    if ((mp_size_t) i >= en)
+        return 0;
+
+    unsigned long int d = (unsigned long int) (ep[i] >> shift);
+    if (shift + bits > limbBits && (mp_size_t) i + 1 < en)
+        d |= (unsigned long int) (ep[i + 1] << (limbBits - shift));
+    return d & ((1UL << bits) - 1);
+}
+
+//r = product of the table entries selected by the digits of {ep, en}
+static int fixedPow(mpz_t r, const MontFixedBase *fb, mp_srcptr ep, mp_size_t en) {
+    const MontParams *m = fb->mod;
+    mp_size_t n = m->n;
+    size_t entries = ((size_t) 1 << fb->bits) - 1;
+    mp_limb_t acc[MONT_MAX_LIMBS];
+    int first = 1;
+
+    if (n > MONT_MAX_LIMBS)
+        return -1;
+
+    for (unsigned j = 0; j < fb->windows; j++) {
+        unsigned long int d = expDigit(ep, en, (size_t) j * fb->bits, fb->bits);
+        if (d == 0)
+            continue;
+
+        const mp_limb_t *entry = fb->table + ((size_t) j * entries + d - 1) * n;
+        if (first) {
+            memcpy(acc, entry, n * sizeof(mp_limb_t));
+            first = 0;
+        } else {
+            montMul(acc, acc, entry, m);
+        }
+    }
+
+    if (first) {
+        mpz_set_ui(r, 1);
+        return 0;
+    }
+
+    montFrom(r, acc, m);
+    return 0;
+}
+
+int montFixedPowUi(mpz_t r, const MontFixedBase *fb, unsigned long int e) {
+    size_t span = (size_t) fb->bits * fb->windows;
+    mp_limb_t ep[(sizeof(e) + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t)];
+    mp_size_t en = 0;
+
+    if (span < sizeof(e) * CHAR_BIT && (e >> span) != 0)
+        return -1;
+
+    //Split e into limbs, mp_limb_t may be narrower than unsigned long. The
+    //shift is done in two halves so it stays defined when it is not.
+    const unsigned half = sizeof(mp_limb_t) * CHAR_BIT / 2;
+    for (; e != 0; e = (e >> half) >> half)
+        ep[en++] = (mp_limb_t) e;
+    return fixedPow(r, fb, ep, en);
+}
+
+int montFixedPow(mpz_t r, const MontFixedBase *fb, const mpz_t e) {
+    if (mpz_sgn(e) < 0 || mpz_sizeinbase(e, 2) > (size_t) fb->bits * fb->windows)
+        return -1;
+    return fixedPow(r, fb, mpz_limbs_read(e), (mp_size_t) mpz_size(e));
+}
+
+//Window of the bucket method for num exponents of `bits` bits: each window
+//costs one multiplication per base plus two per bucket, and bits squarings
+//are needed whatever the window
+static unsigned bucketBits(size_t num, unsigned bits) {
+    unsigned best = 1;
+    double bestCost = 0;
+
+    for (unsigned c = 1; c <= 16 && c <= bits; c++) {
+        double cost = (double) ((bits + c - 1) / c) * ((double) num + (double) (2UL << c));
+        if (c == 1 || cost < bestCost) {
+            best = c;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+int montMultiPowUi(mpz_t r, const MontParams *m, const mpz_srcptr *bases, const unsigned long int *e, size_t num) {
+    mp_size_t n = m->n;
+    mp_limb_t acc[MONT_MAX_LIMBS], run[MONT_MAX_LIMBS], sum[MONT_MAX_LIMBS];
+
+    if (n > MONT_MAX_LIMBS)
+        return -1;
+
+    unsigned long int all = 0;
+    for (size_t i = 0; i < num; i++)
+        all |= e[i];
+
+    unsigned bits = 0;
+    while (bits < sizeof(all) * CHAR_BIT && (all >> bits) != 0)
+        bits++;
+    if (bits == 0) {
+        mpz_set_ui(r, 1);
+        return 0;
+    }
+
+    unsigned c = bucketBits(num, bits);
+    size_t buckets = ((size_t) 1 << c) - 1;
+    unsigned long int mask = (1UL << c) - 1;
+
+    mp_limb_t *base = malloc((num + buckets) * n * sizeof(mp_limb_t));
+    unsigned char *used = malloc(buckets);
+    if (base == NULL || used == NULL) {
+        free(base);
+        free(used);
+        return -1;
+    }
+    mp_limb_t *bucket = base + num * n;
+
+    //Into Montgomery form with one montMul by R^2 mod p each, rather than a
+    //division per base
+    mp_limb_t r2[MONT_MAX_LIMBS];
+    mpz_t rm, view;
+    mpz_init_set_ui(rm, 1);
+    mpz_mul_2exp(rm, rm, (mp_bitcnt_t) n * sizeof(mp_limb_t) * CHAR_BIT);
+    mpz_mod(rm, rm, mpz_roinit_n(view, m->p, n));
+    montTo(r2, rm, m);
+    mpz_clear(rm);
+    for (size_t i = 0; i < num; i++) {
+        mp_ptr b = base + i * n;
+        size_t bn = mpz_size(bases[i]);
+        memcpy(b, mpz_limbs_read(bases[i]), bn * sizeof(mp_limb_t));
+        memset(b + bn, 0, (n - bn) * sizeof(mp_limb_t));
+        montMul(b, b, r2, m);
+    }
+
+    //Windows from the top: square the result c times, drop every base into
+    //the bucket of its digit, then fold sum(d * bucket[d]) in as running
+    //products from the highest bucket down
+    int haveAcc = 0;
+    for (unsigned j = (bits + c - 1) / c; j-- > 0;) {
+        for (unsigned k = 0; haveAcc && k < c; k++)
+            montMul(acc, acc, acc, m);
+
+        memset(used, 0, buckets);
+        for (size_t i = 0; i < num; i++) {
+            unsigned long int d = (e[i] >> (j * c)) & mask;
+            if (d == 0)
+                continue;
+
+            mp_ptr b = bucket + (d - 1) * n;
+            if (used[d - 1])
+                montMul(b, b, base + i * n, m);
+            else
+                memcpy(b, base + i * n, n * sizeof(mp_limb_t));
+            used[d - 1] = 1;
+        }
+
+        int haveRun = 0, haveSum = 0;
+        for (size_t d = buckets; d > 0; d--) {
+            if (used[d - 1]) {
+                if (haveRun)
+                    montMul(run, run, bucket + (d - 1) * n, m);
+                else
+                    memcpy(run, bucket + (d - 1) * n, n * sizeof(mp_limb_t));
+                haveRun = 1;
+            }
+            if (!haveRun)
+                continue;
+            if (haveSum)
+                montMul(sum, sum, run, m);
+            else
+                memcpy(sum, run, n * sizeof(mp_limb_t));
+            haveSum = 1;
+        }
+
+        if (!haveSum)
+            continue;
+        if (haveAcc)
+            montMul(acc, acc, sum, m);
+        else
+            memcpy(acc, sum, n * sizeof(mp_limb_t));
+        haveAcc = 1;
+    }
+
+    free(base);
+    free(used);
+
+    if (!haveAcc)
+        mpz_set_ui(r, 1);
+    else
+        montFrom(r, acc, m);
+    return 0;
+}
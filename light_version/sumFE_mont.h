@@ -0,0 +1,61 @@
+#ifndef SUMFE_MONT_H
+#define SUMFE_MONT_H
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Montgomery arithmetic over constant limb arrays, for parameters that are
+//compiled in (see sumFE_gentables.c) rather than parsed at start-up.
+//Residues are n-limb arrays in Montgomery form x*R mod p, with R = B^n.
+
+//Largest modulus handled; scratch lives on the stack
+#ifndef MONT_MAX_BITS
+#define MONT_MAX_BITS 1024
+#endif
+#define MONT_MAX_LIMBS (MONT_MAX_BITS / (8 * (int) sizeof(mp_limb_t)))
+
+typedef struct {
+    const mp_limb_t *p;         //odd modulus, n limbs
+    mp_size_t n;
+    mp_limb_t pinv;             //-1/p mod B
+} MontParams;
+
+//Fixed-base table for a generator g: window j of `bits` exponent bits holds
+//g^(d * 2^(bits*j)) for d = 1 .. 2^bits - 1, in Montgomery form
+typedef struct {
+    const MontParams *mod;
+    const mp_limb_t *table;
+    unsigned bits;
+    unsigned windows;
+    mp_limb_t *owned;           //table built by montFixedInit, NULL for constant tables
+} MontFixedBase;
+
+//Parameters for a modulus known only at run time; p must be odd and stay
+//alive (its limbs are referenced, not copied). Returns -1 if p is too large.
+int montInit(MontParams *m, const mpz_t p);
+
+//Build the table for g at run time, for exponents of up to expBits bits.
+//It takes windows * (2^bits - 1) residues. Returns -1 if out of memory.
+int montFixedInit(MontFixedBase *fb, const MontParams *m, const mpz_t g, unsigned bits, unsigned expBits);
+void montFixedClear(MontFixedBase *fb);
+
+//{rp, n} = {ap, n} * {bp, n} / R mod p (rp may alias the inputs)
+void montMul(mp_ptr rp, mp_srcptr ap, mp_srcptr bp, const MontParams *m);
+
+//r = g^e mod p with one multiplication per nonzero window of e. Returns -1
+//if e is wider than the table or the modulus is too large, 0 otherwise.
+int montFixedPowUi(mpz_t r, const MontFixedBase *fb, unsigned long int e);
+
+//Same for a non-negative mpz exponent
+int montFixedPow(mpz_t r, const MontFixedBase *fb, const mpz_t e);
+
+//r = prod bases[i]^e[i] mod p with the bucket (Pippenger) method: per window
+//of the exponents one multiplication per base and two per bucket, instead of
+//an exponentiation per base. Bases must be reduced mod p. Returns -1 if out
+//of memory or the modulus is too large.
+int montMultiPowUi(mpz_t r, const MontParams *m, const mpz_srcptr *bases, const unsigned long int *e, size_t num);
+
+#endif
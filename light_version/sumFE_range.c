@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sumFE_io.h"
+#include "sumFE_range.h"
+
+#define LOWBIT(i) ((i) & -(i))
+
+void rangeInit(RangeStore *rs, const mpz_t p, uint64_t firstEpoch) {
+    rs->firstEpoch = firstEpoch;
+    rs->count = 0;
+    rs->cap = 0;
+    rs->prod = NULL;
+    rs->masks = NULL;
+    mpz_init_set(rs->p, p);
+}
+
+static void clearNodes(RangeStore *rs) {
+    for (size_t i = 1; i <= rs->count; i++) {
+        mpz_clear(rs->prod[i]);
+        mpz_clear(rs->masks[i]);
+    }
+    rs->count = 0;
+}
+
+void rangeClear(RangeStore *rs) {
+    clearNodes(rs);
+    free(rs->prod);
+    free(rs->masks);
+    rs->prod = NULL;
+    rs->masks = NULL;
+    rs->cap = 0;
+    mpz_clear(rs->p);
+}
+
+//Room for node count + 1 (nodes are 1-based)
+static int reserve(RangeStore *rs) {
+    if (rs->count + 2 <= rs->cap)
+        return 0;
+
+    size_t cap = rs->cap ? 2 * rs->cap : 64;
+    mpz_t *prod = realloc(rs->prod, cap * sizeof(mpz_t));
+    if (prod == NULL)
+        return -1;
+    rs->prod = prod;
+
+    mpz_t *masks = realloc(rs->masks, cap * sizeof(mpz_t));
+    if (masks == NULL)
+        return -1;
+    rs->masks = masks;
+    rs->cap = cap;
+    return 0;
+}
+
+int rangeAppend(RangeStore *rs, uint64_t epoch, const mpz_t second, const mpz_t mask) {
+    if (epoch != rs->firstEpoch + rs->count || reserve(rs) != 0)
+        return -1;
+
+    size_t i = rs->count + 1;
+    mpz_init(rs->prod[i]);
+    mpz_init(rs->masks[i]);
+    mpz_mod(rs->prod[i], second, rs->p);
+    mpz_mod(rs->masks[i], mask, rs->p);
+
+    //Node i also covers the nodes that end inside (i - lowbit(i), i)
+    for (size_t j = i - 1; j > i - LOWBIT(i); j -= LOWBIT(j)) {
+        mpz_mul(rs->prod[i], rs->prod[i], rs->prod[j]);
+        mpz_mod(rs->prod[i], rs->prod[i], rs->p);
+        mpz_mul(rs->masks[i], rs->masks[i], rs->masks[j]);
+        mpz_mod(rs->masks[i], rs->masks[i], rs->p);
+    }
+
+    rs->count = i;
+    return 0;
+}
+
+int rangeUpdate(RangeStore *rs, uint64_t epoch, const mpz_t second, const mpz_t mask) {
+    if (epoch < rs->firstEpoch || epoch - rs->firstEpoch >= rs->count)
+        return -1;
+
+    for (size_t i = epoch - rs->firstEpoch + 1; i <= rs->count; i += LOWBIT(i)) {
+        mpz_mul(rs->prod[i], rs->prod[i], second);
+        mpz_mod(rs->prod[i], rs->prod[i], rs->p);
+        mpz_mul(rs->masks[i], rs->masks[i], mask);
+        mpz_mod(rs->masks[i], rs->masks[i], rs->p);
+    }
+    return 0;
+}
+
+//Secondcomp and mask products of the first n epochs
+static void prefix(const RangeStore *rs, size_t n, mpz_t second, mpz_t mask) {
+    mpz_set_ui(second, 1);
+    mpz_set_ui(mask, 1);
+
+    for (size_t i = n; i > 0; i -= LOWBIT(i)) {
+        mpz_mul(second, second, rs->prod[i]);
+        mpz_mod(second, second, rs->p);
+        mpz_mul(mask, mask, rs->masks[i]);
+        mpz_mod(mask, mask, rs->p);
+    }
+}
+
+int rangeQuery(const RangeStore *rs, uint64_t from, uint64_t to, mpz_t second, mpz_t mask) {
+    if (from > to || from < rs->firstEpoch || to - rs->firstEpoch >= rs->count)
+        return -1;
+
+    prefix(rs, to - rs->firstEpoch + 1, second, mask);
+
+    //Divide out the epochs before the range, both products with one
+    //inversion: 1/s = k/(s*k) and 1/k = s/(s*k)
+    if (from > rs->firstEpoch) {
+        mpz_t s, k, t;
+        mpz_init(s);
+        mpz_init(k);
+        mpz_init(t);
+        prefix(rs, from - rs->firstEpoch, s, k);
+
+        mpz_mul(t, s, k);
+        int ret = mpz_invert(t, t, rs->p) ? 0 : -1;
+        mpz_mul(second, second, t);
+        mpz_mul(second, second, k);
+        mpz_mod(second, second, rs->p);
+        mpz_mul(mask, mask, t);
+        mpz_mul(mask, mask, s);
+        mpz_mod(mask, mask, rs->p);
+
+        mpz_clear(s);
+        mpz_clear(k);
+        mpz_clear(t);
+        if (ret != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int rangeSave(const RangeStore *rs, const char *path, uint64_t fingerprint) {
+    SfeHeader hdr;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    sfeInitHeader(&hdr, SFE_KIND_RANGE, 2, fingerprint, rs->firstEpoch);
+    hdr.count = rs->count;
+
+    int ret = sfeWriteHeader(fp, &hdr);
+    for (size_t i = 1; ret == 0 && i <= rs->count; i++) {
+        ret = sfeWriteId(fp, 0, (uint32_t) (i - 1));
+        if (ret == 0)
+            ret = sfeWriteField(fp, &hdr, rs->prod[i]);
+        if (ret == 0)
+            ret = sfeWriteField(fp, &hdr, rs->masks[i]);
+    }
+
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
+
+int rangeLoad(RangeStore *rs, const char *path, uint64_t fingerprint) {
+    SfeHeader hdr;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    int ret = sfeReadHeader(fp, &hdr);
+    if (ret == 0 && (hdr.kind != SFE_KIND_RANGE || hdr.fields != 2 || hdr.fingerprint != fingerprint))
+        ret = -1;
+
+    uint64_t firstEpoch = rs->firstEpoch;
+    clearNodes(rs);
+    if (ret == 0)
+        rs->firstEpoch = hdr.epoch;
+
+    //Nodes are stored as they are, nothing is recomputed
+    for (uint64_t n = 0; ret == 0 && n < hdr.count; n++) {
+        uint32_t offset;
+        if (reserve(rs) != 0) {
+            ret = -1;
+            break;
+        }
+
+        size_t i = rs->count + 1;
+        mpz_init(rs->prod[i]);
+        mpz_init(rs->masks[i]);
+        rs->count = i;
+
+        ret = sfeReadId(fp, NULL, &offset);
+        if (ret == 0)
+            ret = sfeReadField(fp, &hdr, rs->prod[i]);
+        if (ret == 0)
+            ret = sfeReadField(fp, &hdr, rs->masks[i]);
+        if (ret == 0 && offset != n)
+            ret = -1;
+    }
+
+    fclose(fp);
+    if (ret != 0) {
+        clearNodes(rs);
+        rs->firstEpoch = firstEpoch;
+    }
+    return ret;
+}
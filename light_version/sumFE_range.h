@@ -0,0 +1,55 @@
+#ifndef SUMFE_RANGE_H
+#define SUMFE_RANGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Store of per-epoch aggregates answering sums over epoch ranges.
+//
+//Epochs are kept in a Fenwick tree: node i holds the products mod p of the
+//aggregated secondcomps of epochs (i - lowbit(i), i] and of their masks. An
+//epoch's mask is g^(r * msk) for the r and the users of that epoch, its
+//aggregate's firstcomp raised to msk: the epochs have different r and
+//users, so a range decrypts by dividing its secondcomp product by its mask
+//product. A range costs two prefix walks of O(log n) multiplications and
+//one inversion, whatever its length.
+typedef struct {
+    uint64_t firstEpoch;
+    size_t count;               //epochs stored
+    size_t cap;
+    mpz_t *prod;                //nodes 1 .. count
+    mpz_t *masks;
+    mpz_t p;
+} RangeStore;
+
+void rangeInit(RangeStore *rs, const mpz_t p, uint64_t firstEpoch);
+void rangeClear(RangeStore *rs);
+
+//All functions below return 0 on success and -1 on failure
+
+//Add the next epoch (firstEpoch + count) with its aggregate secondcomp and
+//mask, firstcomp^msk with msk the key of the users in it
+int rangeAppend(RangeStore *rs, uint64_t epoch, const mpz_t second, const mpz_t mask);
+
+//Fold a late ciphertext into a stored epoch; mask is its firstcomp raised to
+//the secKey of its user
+int rangeUpdate(RangeStore *rs, uint64_t epoch, const mpz_t second, const mpz_t mask);
+
+//secondcomp and mask products of epochs from .. to, both included; second
+//divided by mask is g^sum
+int rangeQuery(const RangeStore *rs, uint64_t from, uint64_t to, mpz_t second, mpz_t mask);
+
+//The store is saved as an SFE_KIND_RANGE container whose header epoch is
+//firstEpoch and whose record i holds node i + 1 (secondcomp, mask)
+int rangeSave(const RangeStore *rs, const char *path, uint64_t fingerprint);
+
+//rs must have been initialised with the same p; on failure it is left empty
+int rangeLoad(RangeStore *rs, const char *path, uint64_t fingerprint);
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumFE_rng.h"
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d)                 \
+    do {                                    \
+        a += b; d ^= a; d = ROTL(d, 16);    \
+        c += d; b ^= c; b = ROTL(b, 12);    \
+        a += b; d ^= a; d = ROTL(d, 8);     \
+        c += d; b ^= c; b = ROTL(b, 7);     \
+    } while (0)
+
+static uint32_t getLE32(const unsigned char *b) {
+    return (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+//One 64-byte block for the stream's current counter
+static void chachaBlock(RngStream *s, unsigned char out[64]) {
+    uint32_t in[16], x[16];
+
+    in[0] = 0x61707865;
+    in[1] = 0x3320646e;
+    in[2] = 0x79622d32;
+    in[3] = 0x6b206574;
+    memcpy(in + 4, s->key, sizeof(s->key));
+    in[12] = (uint32_t) s->counter;
+    in[13] = (uint32_t) (s->counter >> 32);
+    in[14] = (uint32_t) s->stream;
+    in[15] = (uint32_t) (s->stream >> 32);
+    s->counter++;
+
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + in[i];
+        out[4 * i] = (unsigned char) v;
+        out[4 * i + 1] = (unsigned char) (v >> 8);
+        out[4 * i + 2] = (unsigned char) (v >> 16);
+        out[4 * i + 3] = (unsigned char) (v >> 24);
+    }
+}
+
+int rngSystemSeed(unsigned char seed[RNG_SEED_SIZE]) {
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (fp == NULL)
+        return -1;
+
+    size_t n = fread(seed, 1, RNG_SEED_SIZE, fp);
+    fclose(fp);
+    return n == RNG_SEED_SIZE ? 0 : -1;
+}
+
+void rngInit(RngStream *s, const unsigned char seed[RNG_SEED_SIZE], uint64_t stream) {
+    for (int i = 0; i < 8; i++)
+        s->key[i] = getLE32(seed + 4 * i);
+    s->stream = stream;
+    s->counter = 0;
+    s->avail = 0;
+}
+
+void rngBytes(RngStream *s, unsigned char *out, size_t len) {
+    //Leftovers of the previous block first, then whole blocks straight into out
+    size_t n = len < s->avail ? len : s->avail;
+    memcpy(out, s->buf + sizeof(s->buf) - s->avail, n);
+    s->avail -= n;
+    out += n;
+    len -= n;
+
+    for (; len >= sizeof(s->buf); out += sizeof(s->buf), len -= sizeof(s->buf))
+        chachaBlock(s, out);
+
+    if (len > 0) {
+        chachaBlock(s, s->buf);
+        memcpy(out, s->buf, len);
+        s->avail = sizeof(s->buf) - len;
+    }
+}
+
+int rngUniformMod(RngStream *s, mpz_t r, const mpz_t m) {
+    size_t bits = mpz_sizeinbase(m, 2);
+    size_t len = (bits + 7) / 8;
+    unsigned char buf[256];
+    unsigned char *b = buf;
+
+    if (len > sizeof(buf)) {
+        b = (unsigned char *) malloc(len);
+        if (b == NULL)
+            return -1;
+    }
+
+    //Draw exactly as many bits as m has; fewer than two tries on average
+    do {
+        rngBytes(s, b, len);
+        b[0] &= (unsigned char) (0xff >> (8 * len - bits));
+        mpz_import(r, len, 1, 1, 1, 0, b);
+    } while (mpz_cmp(r, m) >= 0);
+
+    memset(b, 0, len);
+    if (b != buf)
+        free(b);
+    return 0;
+}
+
+int rngFillMod(RngStream *s, mpz_t *out, size_t count, const mpz_t m) {
+    for (size_t i = 0; i < count; i++) {
+        if (rngUniformMod(s, out[i], m) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+void rngClear(RngStream *s) {
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,46 @@
+#ifndef SUMFE_RNG_H
+#define SUMFE_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//ChaCha20 in counter mode as a deterministic random generator.
+//
+//One 32-byte seed keys every stream; the 64-bit stream id takes the place of
+//the nonce, so substreams (one per thread, per user or per epoch) are
+//independent and need no coordination. A stream is good for 2^64 blocks.
+//Streams are not thread safe, give every thread its own.
+
+#define RNG_SEED_SIZE 32
+
+typedef struct {
+    uint32_t key[8];
+    uint64_t stream;
+    uint64_t counter;
+    unsigned char buf[64];
+    unsigned avail;             //unused bytes at the end of buf
+} RngStream;
+
+//Fill a seed from the operating system; returns 0 on success, -1 on failure
+int rngSystemSeed(unsigned char seed[RNG_SEED_SIZE]);
+
+void rngInit(RngStream *s, const unsigned char seed[RNG_SEED_SIZE], uint64_t stream);
+void rngBytes(RngStream *s, unsigned char *out, size_t len);
+
+//Uniform in [0, m) by rejection, m > 0. Returns 0 on success, -1 if memory
+//ran out (only for m wider than 2048 bits)
+int rngUniformMod(RngStream *s, mpz_t r, const mpz_t m);
+
+//Bulk version: out[0 .. count-1] uniform in [0, m)
+int rngFillMod(RngStream *s, mpz_t *out, size_t count, const mpz_t m);
+
+//Wipe the key and buffered output
+void rngClear(RngStream *s);
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+#include "sumFE_subset.h"
+
+int subsetInit(SubsetSums *ss, const KeyStore *ks, const mpz_t p) {
+    ss->ks = ks;
+    ss->blocks = (ks->count + BITMAP_CHUNK_SIZE - 1) / BITMAP_CHUNK_SIZE;
+    ss->blockSums = malloc((ss->blocks > 0 ? ss->blocks : 1) * sizeof(mpz_t));
+    ss->scratch = malloc(BITMAP_CHUNK_SIZE * sizeof(uint16_t));
+    if (ss->blockSums == NULL || ss->scratch == NULL) {
+        free(ss->blockSums);
+        free(ss->scratch);
+        return -1;
+    }
+
+    mpz_init_set(ss->order, p);
+    mpz_sub_ui(ss->order, ss->order, 1);
+
+    for (size_t b = 0; b < ss->blocks; b++) {
+        size_t begin = b * BITMAP_CHUNK_SIZE;
+        size_t end = begin + BITMAP_CHUNK_SIZE < ks->count ? begin + BITMAP_CHUNK_SIZE : ks->count;
+
+        mpz_init(ss->blockSums[b]);
+        for (size_t i = begin; i < end; i++) {
+            mpz_t view;
+            mpz_add(ss->blockSums[b], ss->blockSums[b], keyStoreSec(ks, i, view));
+        }
+        mpz_mod(ss->blockSums[b], ss->blockSums[b], ss->order);
+    }
+    return 0;
+}
+
+void subsetClear(SubsetSums *ss) {
+    for (size_t b = 0; b < ss->blocks; b++)
+        mpz_clear(ss->blockSums[b]);
+    free(ss->blockSums);
+    free(ss->scratch);
+    mpz_clear(ss->order);
+    ss->blocks = 0;
+}
+
+void subsetMasterKey(mpz_t msk, SubsetSums *ss, const Bitmap *present) {
+    mpz_set_ui(msk, 0);
+
+    for (size_t b = 0; b < ss->blocks; b++) {
+        size_t base = b * BITMAP_CHUNK_SIZE;
+        uint32_t size = ss->ks->count - base < BITMAP_CHUNK_SIZE ? (uint32_t) (ss->ks->count - base) : BITMAP_CHUNK_SIZE;
+        const BitmapChunk *c = bitmapFind(present, (uint16_t) b);
+
+        //Present slots past the end of the store do not count
+        uint32_t card = c == NULL ? 0 : c->card;
+        if (c != NULL && size < BITMAP_CHUNK_SIZE)
+            card = (uint32_t) bitmapChunkList(c, 0, size, ss->scratch);
+
+        if (card == 0)
+            continue;
+
+        //Add the present keys or subtract the missing ones, whichever is fewer
+        int missing = size - card < card;
+        if (missing)
+            mpz_add(msk, msk, ss->blockSums[b]);
+        if (card == size)
+            continue;
+
+        size_t n = bitmapChunkList(c, missing, size, ss->scratch);
+        for (size_t i = 0; i < n; i++) {
+            mpz_t view;
+            mpz_srcptr key = keyStoreSec(ss->ks, base + ss->scratch[i], view);
+            if (missing)
+                mpz_sub(msk, msk, key);
+            else
+                mpz_add(msk, msk, key);
+        }
+    }
+
+    mpz_mod(msk, msk, ss->order);
+}
@@ -0,0 +1,38 @@
+#ifndef SUMFE_SUBSET_H
+#define SUMFE_SUBSET_H
+
+#include <stddef.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+#include "sumFE_bitmap.h"
+#include "sumFE_keys.h"
+
+//Master key of the users that actually submitted in an epoch.
+//
+//The secret keys of a key store are summed per bitmap chunk once. A subset
+//msk then costs, per chunk, the smaller of the number of present and of
+//missing users in additions: a full chunk is its precomputed sum, a chunk
+//with a few dropouts is its sum minus the missing keys, and a sparse chunk
+//is summed directly.
+typedef struct {
+    const KeyStore *ks;
+    mpz_t order;                //p-1
+    mpz_t *blockSums;           //block i holds slots [i << BITMAP_CHUNK_BITS, ...)
+    size_t blocks;
+    uint16_t *scratch;          //BITMAP_CHUNK_SIZE slot list
+} SubsetSums;
+
+//Precompute the block sums of ks; 0 on success, -1 if memory ran out
+int subsetInit(SubsetSums *ss, const KeyStore *ks, const mpz_t p);
+void subsetClear(SubsetSums *ss);
+
+//msk (initialised) = sum of the secret keys of the slots in present, mod
+//p-1. Slots past the end of the store are ignored.
+void subsetMasterKey(mpz_t msk, SubsetSums *ss, const Bitmap *present);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sumFE_userindex.h"
+
+//Interning blocks, IDs longer than this get a block of their own
+#define USERINDEX_BLOCK_SIZE (64 * 1024)
+
+uint64_t userIndexHash(const char *id, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) id[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+//Home position: Fibonacci hashing spreads FNV's weak low bits over the table
+static size_t home(const UserIndex *ui, uint64_t hash) {
+    return (size_t) ((hash * 0x9e3779b97f4a7c15ULL) >> ui->shift);
+}
+
+static int allocTable(UserIndex *ui, size_t size) {
+    UserIndexEntry *t = malloc(size * sizeof(UserIndexEntry));
+    if (t == NULL)
+        return -1;
+
+    for (size_t i = 0; i < size; i++)
+        t[i].slot = USERINDEX_EMPTY;
+
+    ui->table = t;
+    ui->mask = size - 1;
+    ui->shift = 64;
+    while (size > 1) {
+        size >>= 1;
+        ui->shift--;
+    }
+    return 0;
+}
+
+int userIndexInit(UserIndex *ui, size_t expected) {
+    memset(ui, 0, sizeof(*ui));
+
+    //Keep the table at most half full
+    size_t size = 16;
+    while (size < 2 * expected)
+        size *= 2;
+    return allocTable(ui, size);
+}
+
+void userIndexFree(UserIndex *ui) {
+    for (size_t i = 0; i < ui->numBlocks; i++)
+        free(ui->blocks[i]);
+    free(ui->blocks);
+    free(ui->ids);
+    free(ui->table);
+    memset(ui, 0, sizeof(*ui));
+}
+
+static int grow(UserIndex *ui) {
+    UserIndexEntry *old = ui->table;
+    size_t oldSize = ui->mask + 1;
+
+    if (allocTable(ui, 2 * oldSize) != 0) {
+        ui->table = old;
+        return -1;
+    }
+
+    //The stored hashes are enough to move the entries
+    for (size_t i = 0; i < oldSize; i++) {
+        if (old[i].slot == USERINDEX_EMPTY)
+            continue;
+        size_t j = home(ui, old[i].hash);
+        while (ui->table[j].slot != USERINDEX_EMPTY)
+            j = (j + 1) & ui->mask;
+        ui->table[j] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static char *intern(UserIndex *ui, const char *id, size_t len) {
+    if (ui->block == NULL || ui->blockSize - ui->blockUsed < len + 1) {
+        size_t size = len + 1 > USERINDEX_BLOCK_SIZE ? len + 1 : USERINDEX_BLOCK_SIZE;
+        char **blocks = realloc(ui->blocks, (ui->numBlocks + 1) * sizeof(char *));
+        if (blocks == NULL)
+            return NULL;
+        ui->blocks = blocks;
+
+        char *block = malloc(size);
+        if (block == NULL)
+            return NULL;
+        ui->blocks[ui->numBlocks++] = block;
+        ui->block = block;
+        ui->blockUsed = 0;
+        ui->blockSize = size;
+    }
+
+    char *s = ui->block + ui->blockUsed;
+    memcpy(s, id, len);
+    s[len] = '\0';
+    ui->blockUsed += len + 1;
+    return s;
+}
+
+//Entry holding the ID, or the free entry where it would go
+static UserIndexEntry *probe(const UserIndex *ui, const char *id, size_t len, uint64_t hash) {
+    size_t j = home(ui, hash);
+
+    for (;;) {
+        UserIndexEntry *e = &ui->table[j];
+        if (e->slot == USERINDEX_EMPTY)
+            return e;
+        if (e->hash == hash && e->len == len && memcmp(ui->ids[e->slot], id, len) == 0)
+            return e;
+        j = (j + 1) & ui->mask;
+    }
+}
+
+int userIndexInsert(UserIndex *ui, const char *id, size_t len, uint32_t *slot) {
+    uint64_t hash = userIndexHash(id, len);
+    UserIndexEntry *e = probe(ui, id, len, hash);
+
+    if (e->slot != USERINDEX_EMPTY) {
+        *slot = e->slot;
+        return 0;
+    }
+    if (ui->count >= USERINDEX_EMPTY || len > UINT32_MAX)
+        return -1;
+
+    if (2 * (ui->count + 1) > ui->mask + 1) {
+        if (grow(ui) != 0)
+            return -1;
+        e = probe(ui, id, len, hash);
+    }
+
+    if (ui->count == ui->idsCap) {
+        size_t cap = ui->idsCap ? 2 * ui->idsCap : 64;
+        char **ids = realloc(ui->ids, cap * sizeof(char *));
+        if (ids == NULL)
+            return -1;
+        ui->ids = ids;
+        ui->idsCap = cap;
+    }
+
+    char *s = intern(ui, id, len);
+    if (s == NULL)
+        return -1;
+
+    ui->ids[ui->count] = s;
+    e->hash = hash;
+    e->len = (uint32_t) len;
+    e->slot = (uint32_t) ui->count;
+    *slot = e->slot;
+    ui->count++;
+    return 0;
+}
+
+int64_t userIndexFind(const UserIndex *ui, const char *id, size_t len) {
+    const UserIndexEntry *e = probe(ui, id, len, userIndexHash(id, len));
+    return e->slot == USERINDEX_EMPTY ? -1 : (int64_t) e->slot;
+}
+
+const char *userIndexId(const UserIndex *ui, uint32_t slot) {
+    return slot < ui->count ? ui->ids[slot] : NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef SUMFE_USERINDEX_H
+#define SUMFE_USERINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Index from user ID to dense slot number.
+//
+//IDs are interned: the index keeps one copy of every ID in large blocks it
+//owns, and slot i's copy stays valid (and at the same address) until the
+//index is freed. The table itself is open addressing with linear probing
+//over 16-byte entries carrying the full hash, so a lookup usually touches
+//one cache line of the table and one of the interned string.
+
+typedef struct {
+    uint64_t hash;
+    uint32_t slot;              //USERINDEX_EMPTY for a free entry
+    uint32_t len;
+} UserIndexEntry;
+
+#define USERINDEX_EMPTY UINT32_MAX
+
+typedef struct {
+    UserIndexEntry *table;
+    size_t mask;                //table size - 1, a power of two
+    int shift;                  //64 - log2(table size)
+
+    char **ids;                 //interned ID of each slot
+    size_t count;
+    size_t idsCap;
+
+    char *block;                //current interning block
+    size_t blockUsed;
+    size_t blockSize;
+    char **blocks;              //all blocks, for freeing
+    size_t numBlocks;
+} UserIndex;
+
+//Empty index sized for about `expected` users; 0 on success, -1 if memory
+//ran out (as for every function below that returns int)
+int userIndexInit(UserIndex *ui, size_t expected);
+void userIndexFree(UserIndex *ui);
+
+//FNV-1a of the ID, the same value as keyIdHash for a NUL-terminated ID
+uint64_t userIndexHash(const char *id, size_t len);
+
+//Slot of the ID, adding it with the next free slot if it is new
+int userIndexInsert(UserIndex *ui, const char *id, size_t len, uint32_t *slot);
+
+//Slot of the ID, -1 if it is not indexed
+int64_t userIndexFind(const UserIndex *ui, const char *id, size_t len);
+
+//Interned, NUL-terminated ID of a slot
+const char *userIndexId(const UserIndex *ui, uint32_t slot);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+
+#include "sumFE_window.h"
+
+int windowInit(SlidingWindow *w, size_t size, const mpz_t p) {
+    if (size == 0)
+        return -1;
+
+    w->size = size;
+    w->fill = 0;
+    w->head = 0;
+    w->values = malloc(2 * size * sizeof(mpz_t));
+    w->inverses = malloc(2 * size * sizeof(mpz_t));
+    w->scratch = malloc(2 * size * sizeof(mpz_t));
+    w->inverted = calloc(size, 1);
+    if (w->values == NULL || w->inverses == NULL || w->scratch == NULL || w->inverted == NULL) {
+        free(w->values);
+        free(w->inverses);
+        free(w->scratch);
+        free(w->inverted);
+        return -1;
+    }
+
+    for (size_t i = 0; i < 2 * size; i++) {
+        mpz_init2(w->values[i], mpz_sizeinbase(p, 2));
+        mpz_init2(w->inverses[i], mpz_sizeinbase(p, 2));
+        mpz_init2(w->scratch[i], mpz_sizeinbase(p, 2));
+    }
+
+    mpz_init_set_ui(w->prod, 1);
+    mpz_init_set_ui(w->first, 1);
+    mpz_init_set(w->p, p);
+    return 0;
+}
+
+void windowClear(SlidingWindow *w) {
+    for (size_t i = 0; i < 2 * w->size; i++) {
+        mpz_clear(w->values[i]);
+        mpz_clear(w->inverses[i]);
+        mpz_clear(w->scratch[i]);
+    }
+    free(w->values);
+    free(w->inverses);
+    free(w->scratch);
+    free(w->inverted);
+    mpz_clear(w->prod);
+    mpz_clear(w->first);
+    mpz_clear(w->p);
+    w->size = 0;
+    w->fill = 0;
+}
+
+//Slot of component c of the k-th epoch from ring position start
+static size_t slot(const SlidingWindow *w, size_t start, size_t k, size_t c) {
+    return 2 * ((start + k) % w->size) + c;
+}
+
+//Invert both components of every epoch in the window that has no inverses
+//yet. They are the newest ones, pushed since the last batch.
+static int invertBatch(SlidingWindow *w) {
+    size_t first = 0;
+    while (first < w->fill && w->inverted[(w->head + first) % w->size])
+        first++;
+
+    size_t n = 2 * (w->fill - first);
+    if (n == 0)
+        return 0;
+
+    //scratch[k] = v[0] * .. * v[k], two components per epoch
+    size_t start = w->head + first;
+    for (size_t k = 0; k < n; k++) {
+        size_t i = slot(w, start, k / 2, k % 2);
+        if (k == 0)
+            mpz_set(w->scratch[0], w->values[i]);
+        else {
+            mpz_mul(w->scratch[k], w->scratch[k - 1], w->values[i]);
+            mpz_mod(w->scratch[k], w->scratch[k], w->p);
+        }
+    }
+
+    mpz_t t;
+    mpz_init(t);
+    if (!mpz_invert(t, w->scratch[n - 1], w->p)) {
+        mpz_clear(t);
+        return -1;
+    }
+
+    //Peel one value off the inverted product at a time
+    for (size_t k = n - 1; k > 0; k--) {
+        size_t i = slot(w, start, k / 2, k % 2);
+        mpz_mul(w->inverses[i], t, w->scratch[k - 1]);
+        mpz_mod(w->inverses[i], w->inverses[i], w->p);
+        mpz_mul(t, t, w->values[i]);
+        mpz_mod(t, t, w->p);
+    }
+    mpz_set(w->inverses[slot(w, start, 0, 0)], t);
+
+    for (size_t k = 0; k < n / 2; k++)
+        w->inverted[(start + k) % w->size] = 1;
+
+    mpz_clear(t);
+    return 0;
+}
+
+int windowPush(SlidingWindow *w, const mpz_t first, const mpz_t second) {
+    if (w->fill == w->size) {
+        if (!w->inverted[w->head] && invertBatch(w) != 0)
+            return -1;
+
+        mpz_mul(w->prod, w->prod, w->inverses[2 * w->head]);
+        mpz_mod(w->prod, w->prod, w->p);
+        mpz_mul(w->first, w->first, w->inverses[2 * w->head + 1]);
+        mpz_mod(w->first, w->first, w->p);
+
+        w->inverted[w->head] = 0;
+        w->head = (w->head + 1) % w->size;
+        w->fill--;
+    }
+
+    size_t i = (w->head + w->fill) % w->size;
+    mpz_mod(w->values[2 * i], second, w->p);
+    mpz_mod(w->values[2 * i + 1], first, w->p);
+    w->fill++;
+
+    mpz_mul(w->prod, w->prod, w->values[2 * i]);
+    mpz_mod(w->prod, w->prod, w->p);
+    mpz_mul(w->first, w->first, w->values[2 * i + 1]);
+    mpz_mod(w->first, w->first, w->p);
+    return 0;
+}
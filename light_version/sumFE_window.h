@@ -0,0 +1,44 @@
+#ifndef SUMFE_WINDOW_H
+#define SUMFE_WINDOW_H
+
+#include <stddef.h>
+
+#ifdef SUMFE_USE_GMP
+#include <gmp.h>
+#else
+#include "mini-gmp.h"
+#endif
+
+//Rolling aggregate over the last `size` epochs.
+//
+//prod and first are the running products mod p of the epochs' aggregated
+//secondcomps and firstcomps. The epochs have different r, so the window is a
+//ciphertext with firstcomp the product of their g^r, which decrypts with msk
+//while the epochs keep the same users. Pushing an epoch into a full window
+//evicts the oldest by multiplying in the inverses of its two components.
+//Inverses are not computed one at a time: when the oldest epoch has none
+//yet, every epoch still without one is inverted together (Montgomery's
+//trick, one mpz_invert and three multiplications per component), so a push
+//costs O(1) multiplications amortized and one inversion per `size` epochs.
+typedef struct {
+    size_t size;
+    size_t fill;                //epochs in the window
+    size_t head;                //ring position of the oldest
+    mpz_t *values;              //secondcomp of ring position i at 2i, firstcomp at 2i + 1
+    mpz_t *inverses;
+    unsigned char *inverted;
+    mpz_t *scratch;             //prefix products of a batch inversion
+    mpz_t prod;
+    mpz_t first;
+    mpz_t p;
+} SlidingWindow;
+
+//0 on success, -1 if memory ran out
+int windowInit(SlidingWindow *w, size_t size, const mpz_t p);
+void windowClear(SlidingWindow *w);
+
+//Add the next epoch's aggregate; -1 if an evicted component has no inverse
+//mod p
+int windowPush(SlidingWindow *w, const mpz_t first, const mpz_t second);
+
+#endif
@@ -0,0 +1,119 @@
+/* Threshold tuning for the multiplication code in mini-gmp.c.
+
+   Build and run on the target, then pass the reported values to the
+   compiler when building mini-gmp.c, e.g.
+
+     gcc -O2 -o tune-mini-gmp tune-mini-gmp.c
+     ./tune-mini-gmp
+     gcc -O2 -DMUL_TOOM22_THRESHOLD=.. -DMUL_TOOM33_THRESHOLD=.. \
+         -DSQR_TOOM2_THRESHOLD=.. -DSQR_TOOM3_THRESHOLD=.. -c mini-gmp.c
+
+   The thresholds are variables in this build, so each algorithm can be
+   timed against the one below it at the top level of the recursion. */
+
+#define TUNE_PROGRAM_BUILD 1
+#include "mini-gmp.c"
+
+#include <time.h>
+
+#define TUNE_MAX_SIZE 400
+#define TUNE_MIN_TIME 0.02
+
+/* Consecutive sizes that must agree before a threshold is accepted */
+#define TUNE_STREAK 3
+
+static mp_limb_t up[TUNE_MAX_SIZE], vp[TUNE_MAX_SIZE], rp[2 * TUNE_MAX_SIZE];
+
+/* Time mpn_sqr instead of mpn_mul_n */
+static int tune_sqr;
+
+static double
+seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Time per call of mpn_mul_n (or mpn_sqr) for the current thresholds */
+static double
+time_mul (mp_size_t n)
+{
+  unsigned long reps, i;
+  double start, elapsed;
+
+  for (reps = 1;; reps *= 2)
+    {
+      start = seconds ();
+      for (i = 0; i < reps; i++)
+	if (tune_sqr)
+	  mpn_sqr (rp, up, n);
+	else
+	  mpn_mul_n (rp, up, vp, n);
+      elapsed = seconds () - start;
+      if (elapsed >= TUNE_MIN_TIME)
+	return elapsed / reps;
+    }
+}
+
+/* Smallest size from which setting *threshold = n (the faster algorithm at
+   the top level only) beats leaving it above n, for TUNE_STREAK sizes in
+   a row. */
+static mp_size_t
+tune_threshold (const char *name, mp_size_t *threshold, mp_size_t start)
+{
+  mp_size_t n, first = 0;
+  int streak = 0;
+
+  for (n = start; n < TUNE_MAX_SIZE; n++)
+    {
+      double below, above;
+
+      *threshold = n + 1;
+      below = time_mul (n);
+      *threshold = n;
+      above = time_mul (n);
+
+      if (above < below)
+	{
+	  if (streak++ == 0)
+	    first = n;
+	  if (streak == TUNE_STREAK)
+	    break;
+	}
+      else
+	streak = 0;
+    }
+
+  if (streak < TUNE_STREAK)
+    first = TUNE_MAX_SIZE;
+  *threshold = first;
+  printf ("#define %s %ld\n", name, (long) first);
+  fflush (stdout);
+  return first;
+}
+
+int
+main (void)
+{
+  mp_size_t i;
+
+  srand (1);
+  for (i = 0; i < TUNE_MAX_SIZE; i++)
+    {
+      up[i] = ((mp_limb_t) rand () << (GMP_LIMB_BITS / 2)) ^ (mp_limb_t) rand ();
+      vp[i] = ((mp_limb_t) rand () << (GMP_LIMB_BITS / 2)) ^ (mp_limb_t) rand ();
+    }
+
+  mul_toom33_threshold = TUNE_MAX_SIZE;
+  tune_threshold ("MUL_TOOM22_THRESHOLD", &mul_toom22_threshold, 4);
+  tune_threshold ("MUL_TOOM33_THRESHOLD", &mul_toom33_threshold,
+		  GMP_MAX (mul_toom22_threshold, 9));
+
+  tune_sqr = 1;
+  sqr_toom3_threshold = TUNE_MAX_SIZE;
+  tune_threshold ("SQR_TOOM2_THRESHOLD", &sqr_toom2_threshold, 4);
+  tune_threshold ("SQR_TOOM3_THRESHOLD", &sqr_toom3_threshold,
+		  GMP_MAX (sqr_toom2_threshold, 9));
+  return 0;
+}
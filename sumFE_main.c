@@ -1,11 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "light_version/sumFE_arena.h"
+#include "light_version/sumFE_io.h"
+#include "light_version/sumFE_epoch.h"
+#include "light_version/sumFE_mont.h"
+#include "light_version/sumFE_keys.h"
+#include "light_version/sumFE_rng.h"
+#include "light_version/sumFE_bitmap.h"
+#include "light_version/sumFE_subset.h"
+#include "light_version/sumFE_userindex.h"
+#include "light_version/sumFE_range.h"
+#include "light_version/sumFE_groups.h"
+#include "light_version/sumFE_dlog.h"
 
 #define NUM 200
 #define PRECOMP 500000
 
+//Window of the fixed-base table for g^sk: 4 MB, 127 multiplications per key
+#define KEYGEN_WINDOW 8
+
+//Secret keys drawn per call into the generator
+#define KEYGEN_BLOCK 32
+
+//Every run is stored as the next epoch of epochs.bin; the range decrypted
+//is the last RANGE_EPOCHS of them, small enough for the PRECOMP table
+#define RANGE_EPOCHS 2
+
+//Users are spread over this many regions (by slot) for the per-region sums
+#define REGIONS 4
+
+//Tariff of user i for the weighted total: 1 + i % TARIFFS
+#define TARIFFS 3
+
+//Every user also submits a vector of hourly readings for the day
+#define HOURS 24
+
 //Representation of a Ciphertext
 typedef struct {
     mpz_t firstcomp;   
@@ -19,49 +55,171 @@ typedef struct {
     mpz_t secKey;
     mpz_t pubKey;
     unsigned long int plaintext;
+    unsigned long int hourly[HOURS];
 } Users;
 
+//Ciphertext of a vector: coordinate j is encrypted like a scalar plaintext,
+//and with the epoch's shared r all coordinates have the same firstcomp
+typedef struct {
+    mpz_t firstcomp;
+    mpz_t secondcomp[HOURS];
+} VectorCiphertext;
+
 //Users File1[NUM];
 
 void genPreComputedValues(mpz_t g, mpz_t p, int size, mpz_t *values){
+    //Consecutive powers: one modular multiplication per entry
     for (unsigned long int i = 0; i < size; i++){
         mpz_init(values[i]);
-        mpz_powm_ui(values[i], g, i, p);
+        if (i == 0)
+            mpz_set_ui(values[i], 1);
+        else {
+            mpz_mul(values[i], values[i - 1], g);
+            mpz_mod(values[i], values[i], p);
+        }
     }
 }
 
-void genKeyPair(Users *U, int num, mpz_t p, mpz_t g) {    
-    //Set Random parameters
-    gmp_randstate_t st;
-    unsigned long int sd = (unsigned long int) (clock());
-    gmp_randinit_default(st);
-    gmp_randseed_ui(st, sd);
+typedef struct {
+    KeyStore *ks;
+    const MontFixedBase *gTable;
+    mpz_srcptr p, g;
+    size_t begin, end;
+    const unsigned char *seed;
+    uint64_t stream;
+    int failed;
+} KeyGenJob;
+
+//Generate the keys of job's block, using the calling thread's arena
+static void keyGenBlock(KeyGenJob *job) {
+    //Every thread reads its own substream of the run seed, so no state is
+    //shared between threads
+    RngStream rng;
+    rngInit(&rng, job->seed, job->stream);
+
+    //Secret keys are exponents of g, whose order divides p-1
+    mpz_t order, pKey, sKey[KEYGEN_BLOCK];
+    mpz_init_set(order, job->p);
+    mpz_sub_ui(order, order, 1);
+    mpz_init2(pKey, mpz_sizeinbase(job->p, 2));
+    for (int k = 0; k < KEYGEN_BLOCK; k++)
+        mpz_init2(sKey[k], mpz_sizeinbase(job->p, 2));
+
+    for (size_t i = job->begin; i < job->end; i += KEYGEN_BLOCK) {
+        size_t n = job->end - i < KEYGEN_BLOCK ? job->end - i : KEYGEN_BLOCK;
+        if (rngFillMod(&rng, sKey, n, order) != 0) {
+            job->failed = 1;
+            break;
+        }
 
-    for (int i = 0; i < num; i++) {
-        //Initialise the parameters
-        mpz_t sKey, pKey;
-        mpz_init(sKey);
-        mpz_init(pKey);
+        for (size_t k = 0; k < n; k++) {
+            size_t mark = arenaEpochBegin();
+
+            //Calculate the public key based on the secret key
+            if (montFixedPow(pKey, job->gTable, sKey[k]) != 0)
+                mpz_powm_sec(pKey, job->g, sKey[k], job->p);
+
+            if (keyStoreSet(job->ks, i + k, sKey[k], pKey) != 0)
+                job->failed = 1;
+
+            arenaEpochEnd(mark);
+        }
+    }
+
+    for (int k = 0; k < KEYGEN_BLOCK; k++)
+        mpz_clear(sKey[k]);
+    mpz_clear(pKey);
+    mpz_clear(order);
+    rngClear(&rng);
+}
+
+static void *keyGenWorker(void *arg) {
+    arenaThreadInit(0);
+    keyGenBlock(arg);
+    arenaThreadFree();
+    return NULL;
+}
+
+//Generate the key pairs of num users into ks, splitting the users between
+//threads, and point U's keys at the store
+int genKeyPairs(KeyStore *ks, Users *U, int num, mpz_t p, mpz_t g, int threads) {
+    MontParams mod;
+    MontFixedBase gTable;
+
+    if (montInit(&mod, p) != 0 || montFixedInit(&gTable, &mod, g, KEYGEN_WINDOW, mpz_sizeinbase(p, 2)) != 0)
+        return -1;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > num)
+        threads = num > 0 ? num : 1;
+
+    unsigned char seed[RNG_SEED_SIZE];
+
+    if (rngSystemSeed(seed) != 0) {
+        montFixedClear(&gTable);
+        return -1;
+    }
 
-        //Generate a random secret key based on p
-        mpz_urandomm(sKey, st, p);
+    KeyGenJob *jobs = calloc(threads, sizeof(KeyGenJob));
+    pthread_t *tid = calloc(threads, sizeof(pthread_t));
+    int *started = calloc(threads, sizeof(int));
+
+    if (jobs == NULL || tid == NULL || started == NULL) {
+        free(jobs);
+        free(tid);
+        free(started);
+        memset(seed, 0, sizeof(seed));
+        montFixedClear(&gTable);
+        return -1;
+    }
 
-        //Calculate the public key based on the secret key
-        mpz_powm_sec(pKey, g, sKey, p);
+    for (int t = 0; t < threads; t++) {
+        jobs[t].ks = ks;
+        jobs[t].gTable = &gTable;
+        jobs[t].p = p;
+        jobs[t].g = g;
+        jobs[t].begin = (size_t) num * t / threads;
+        jobs[t].end = (size_t) num * (t + 1) / threads;
+        jobs[t].seed = seed;
+        jobs[t].stream = (uint64_t) t;
+        started[t] = pthread_create(&tid[t], NULL, keyGenWorker, &jobs[t]) == 0;
+    }
 
-        //Store values into the Struct
-        mpz_init_set(U[i].secKey, sKey);
-        mpz_init_set(U[i].pubKey, pKey);
+    //A block whose thread could not be started is generated here instead,
+    //from the same substream
+    int ret = 0;
+    for (int t = 0; t < threads; t++) {
+        if (started[t])
+            pthread_join(tid[t], NULL);
+        else
+            keyGenBlock(&jobs[t]);
+        if (jobs[t].failed)
+            ret = -1;
+    }
 
-        //Clear the temporal parameters from memory
-        mpz_clear(sKey);
-        mpz_clear(pKey);
+    for (int i = 0; i < num; i++) {
+        keyStoreSec(ks, i, U[i].secKey);
+        keyStorePub(ks, i, U[i].pubKey);
     }
+
+    free(jobs);
+    free(tid);
+    free(started);
+    memset(seed, 0, sizeof(seed));
+    montFixedClear(&gTable);
+    return ret;
 }
 
-void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r, int num) {
+void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, const EpochContext *ep, int num) {
     for (int i = 0; i < num; i ++) {
-        mpz_t res1, res2, res3, tmp1, tmp2, tmp3;
+        //The outputs outlive the arena epoch, so reserve them on the heap first
+        mpz_init2(C[i].firstcomp, mpz_sizeinbase(p, 2));
+        mpz_init2(C[i].secondcomp, mpz_sizeinbase(p, 2));
+
+        size_t mark = arenaEpochBegin();
+
+        mpz_t res1, res2, tmp1, tmp2, tmp3;
         mpz_init(res1);
         mpz_init(res2);
         //mpz_init(res3);
@@ -69,12 +227,12 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         mpz_init(tmp2);
         mpz_init(tmp3);
 
-        // (gˆr) % p
-        mpz_powm_ui(res1, g, r, p);
-        // tmp1 = pk ^r
-        mpz_pow_ui(tmp1, U[i].pubKey, r);
-        // tmp2 = g ^ msg
-        mpz_pow_ui(tmp2, g, U[i].plaintext);
+        // (gˆr) % p, shared by the whole epoch
+        mpz_set(res1, ep->firstcomp);
+        // tmp1 = (pk ^r) % p
+        mpz_powm(tmp1, U[i].pubKey, ep->r, p);
+        // tmp2 = (g ^ msg) % p
+        mpz_powm_ui(tmp2, g, U[i].plaintext, p);
         // tmp3 = tmp1 * tmp2
         mpz_mul(tmp3, tmp1, tmp2);
         // res2 = tmp3 % p
@@ -84,8 +242,8 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         //mpz_mul(res3, res1, res2);
 
         //Copy results into struct
-        mpz_init_set(C[i].firstcomp, res1);
-        mpz_init_set(C[i].secondcomp, res2);
+        mpz_set(C[i].firstcomp, res1);
+        mpz_set(C[i].secondcomp, res2);
         //mpz_init_set(C[i].CT, res3);
 
         mpz_clear(res1);
@@ -94,48 +252,190 @@ void HE_Encrypt(Ciphertext *C, Users *U, mpz_t g, mpz_t p, unsigned long int r,
         mpz_clear(tmp1);
         mpz_clear(tmp2);
         mpz_clear(tmp3);
+
+        arenaEpochEnd(mark);
     }
 }
 
-void addCipher(int cnt, Ciphertext *out_cipher, Ciphertext *C, mpz_t g, mpz_t p, unsigned long int r) {
+//Encrypt every user's hourly vector. pk^r is shared by the coordinates, so
+//each coordinate costs one g^m and one modular multiplication
+void HE_EncryptVector(VectorCiphertext *C, Users *U, mpz_t g, mpz_t p, const EpochContext *ep, int num) {
+    for (int i = 0; i < num; i++) {
+        mpz_init_set(C[i].firstcomp, ep->firstcomp);
+        for (int j = 0; j < HOURS; j++)
+            mpz_init2(C[i].secondcomp[j], mpz_sizeinbase(p, 2));
+
+        size_t mark = arenaEpochBegin();
+
+        mpz_t pkr, gm;
+        mpz_init(pkr);
+        mpz_init(gm);
+
+        // pkr = (pk ^r) % p
+        mpz_powm(pkr, U[i].pubKey, ep->r, p);
+        for (int j = 0; j < HOURS; j++) {
+            mpz_powm_ui(gm, g, U[i].hourly[j], p);
+            mpz_mul(gm, gm, pkr);
+            mpz_mod(C[i].secondcomp[j], gm, p);
+        }
+
+        mpz_clear(pkr);
+        mpz_clear(gm);
+
+        arenaEpochEnd(mark);
+    }
+}
+
+void clearVector(VectorCiphertext *C) {
+    mpz_clear(C->firstcomp);
+    for (int j = 0; j < HOURS; j++)
+        mpz_clear(C->secondcomp[j]);
+}
+
+//Coordinate-wise aggregate of the vectors of the users in present; g^r is
+//the one their vectors carry
+void addCipherVector(int cnt, VectorCiphertext *out_cipher, VectorCiphertext *C, mpz_t p, const Bitmap *present) {
+    mpz_init_set_ui(out_cipher->firstcomp, 1);
+    for (int j = 0; j < HOURS; j++)
+        mpz_init_set_ui(out_cipher->secondcomp[j], 1);
+
+    for (int i = 0; i < cnt; i++) {
+        if (present != NULL && !bitmapContains(present, i))
+            continue;
+        mpz_set(out_cipher->firstcomp, C[i].firstcomp);
+        for (int j = 0; j < HOURS; j++) {
+            mpz_mul(out_cipher->secondcomp[j], out_cipher->secondcomp[j], C[i].secondcomp[j]);
+            mpz_mod(out_cipher->secondcomp[j], out_cipher->secondcomp[j], p);
+        }
+    }
+}
+
+//Decrypt all coordinates of an aggregate: every coordinate was summed over
+//the same users, so one firstcomp^(p-1-msk) serves them all, and their
+//discrete logs are looked up as one batch. out[j] is -1 when coordinate j is
+//beyond the table. Returns 0 on success.
+int FE_decryptVector(const VectorCiphertext *c, mpz_t msk, mpz_t p, const DlogTable *dt, long *out) {
+    mpz_t mask, e, gm[HOURS];
+    mpz_srcptr v[HOURS];
+
+    mpz_init(mask);
+    mpz_init_set(e, p);
+    mpz_sub_ui(e, e, 1);
+    mpz_sub(e, e, msk);
+    mpz_powm(mask, c->firstcomp, e, p);
+
+    for (int j = 0; j < HOURS; j++) {
+        mpz_init(gm[j]);
+        mpz_mul(gm[j], c->secondcomp[j], mask);
+        mpz_mod(gm[j], gm[j], p);
+        v[j] = gm[j];
+    }
+
+    int ret = dlogSolve(dt, v, HOURS, out);
+
+    for (int j = 0; j < HOURS; j++)
+        mpz_clear(gm[j]);
+    mpz_clear(mask);
+    mpz_clear(e);
+    return ret;
+}
+
+//Aggregate the ciphertexts of the users in present (all cnt when NULL)
+void addCipher(int cnt, Ciphertext *out_cipher, Ciphertext *C, mpz_t p, const Bitmap *present) {
     //mpz_powm_ui(finalCipher.firstcomp, g, r, p);
+    mpz_init2(out_cipher->firstcomp, mpz_sizeinbase(p, 2));
+    mpz_init2(out_cipher->secondcomp, mpz_sizeinbase(p, 2));
+
+    size_t mark = arenaEpochBegin();
+
     mpz_t res1, res2;
     mpz_init(res1);
     mpz_init(res2);
 
-    //first component of the ciphertext. Same as all ciphertexts
-    mpz_powm_ui(res1, g, r, p);
+    //first component of the ciphertext. Same as all ciphertexts, the g^r
+    //they carry (1 when nobody submitted)
+    mpz_set_ui(res1, 1);
 
-    mpz_set(res2, C[0].secondcomp);
+    mpz_set_ui(res2, 1);
 
-    for (int i = 1; i < cnt; i++){
-        mpz_mul(res2, res2, C[i].secondcomp);
+    for (int i = 0; i < cnt; i++){
+        if (present == NULL || bitmapContains(present, i)) {
+            mpz_set(res1, C[i].firstcomp);
+            mpz_mul(res2, res2, C[i].secondcomp);
+            mpz_mod(res2, res2, p);
+        }
     }
 
     //copy results into the out_cipher
-    mpz_init_set(out_cipher->firstcomp, res1);
-    mpz_init_set(out_cipher->secondcomp, res2);
+    mpz_set(out_cipher->firstcomp, res1);
+    mpz_set(out_cipher->secondcomp, res2);
 
     mpz_clear(res1);
     mpz_clear(res2);
 
+    arenaEpochEnd(mark);
+
 }
 
-void addKeys(int cnt, Users *U, mpz_t msk){
-    mpz_t res;
-    mpz_init(res);
+//Weighted aggregate of the users in present: secondcomp = prod C[i]^w[i] by
+//multi-exponentiation. It is g^(r * sum w[i]*sk[i]) * g^(sum w[i]*m[i]), so
+//firstcomp stays g^r and the weights go into the key (addKeysWeighted)
+int addCipherWeighted(int cnt, Ciphertext *out_cipher, Ciphertext *C, const unsigned long int *weights, mpz_t p, const Bitmap *present) {
+    mpz_srcptr *bases = malloc(cnt * sizeof(mpz_srcptr));
+    unsigned long int *e = malloc(cnt * sizeof(unsigned long int));
+    size_t num = 0;
+    MontParams mod;
+
+    mpz_init2(out_cipher->firstcomp, mpz_sizeinbase(p, 2));
+    mpz_init2(out_cipher->secondcomp, mpz_sizeinbase(p, 2));
+    mpz_set_ui(out_cipher->firstcomp, 1);
+
+    if (bases == NULL || e == NULL) {
+        free(bases);
+        free(e);
+        return -1;
+    }
+
+    for (int i = 0; i < cnt; i++) {
+        if (present != NULL && !bitmapContains(present, i))
+            continue;
+        mpz_set(out_cipher->firstcomp, C[i].firstcomp);
+        bases[num] = C[i].secondcomp;
+        e[num++] = weights[i];
+    }
+
+    int ret = montInit(&mod, p) == 0 ? montMultiPowUi(out_cipher->secondcomp, &mod, bases, e, num) : -1;
+
+    free(bases);
+    free(e);
+    return ret;
+}
 
-    mpz_set(res, U[0].secKey);
+//Matching key: sum of w[i] * secKey[i] over the users in present, mod p-1
+void addKeysWeighted(int cnt, Users *U, const unsigned long int *weights, mpz_t p, const Bitmap *present, mpz_t msk) {
+    mpz_t order;
+    mpz_init_set(order, p);
+    mpz_sub_ui(order, order, 1);
 
-    for (int i = 1; i < cnt; i++){
-        mpz_add(res, res, U[i].secKey);
+    mpz_set_ui(msk, 0);
+    for (int i = 0; i < cnt; i++) {
+        if (present == NULL || bitmapContains(present, i))
+            mpz_addmul_ui(msk, U[i].secKey, weights[i]);
     }
+    mpz_mod(msk, msk, order);
+    mpz_clear(order);
+}
 
-    mpz_init_set(msk, res);
-    mpz_clear(res);
+//Discrete log of gm in the lookup table, -1 if it is not there
+long lookupValue(const DlogTable *dt, const mpz_t gm) {
+    mpz_srcptr v = gm;
+    long out;
+    return dlogSolve(dt, &v, 1, &out) == 0 ? out : -1;
 }
 
 void FE_decrypt(Ciphertext *finalcipher, mpz_t msk, mpz_t p, mpz_t *values, mpz_t k) {
+    size_t mark = arenaEpochBegin();
+
     mpz_t res1, res2, res3, fg;
 
     mpz_init(res1);
@@ -181,12 +481,21 @@ void FE_decrypt(Ciphertext *finalcipher, mpz_t msk, mpz_t p, mpz_t *values, mpz_
     mpz_clear(res1);
     mpz_clear(res2);
     mpz_clear(res3);
+    mpz_clear(fg);
+
+    arenaEpochEnd(mark);
 }
 
-int main() {
-    mpz_t p,g,q,c,k;
+int main(int argc, char **argv) {
+    mpz_t p,g,q,k;
+
+    uint64_t epoch = 0;
 
-    unsigned long int r = 5;
+    //Big-integer temporaries come from a per-thread arena. Everything computed
+    //inside an epoch is reduced mod p (GMP keeps its own scratch on the
+    //stack), so a few KB are used; the high-water mark is reported at the end
+    arenaInstall();
+    arenaThreadInit(64 << 10);
 
     mpz_init_set_str(p, "141103728801468755249503291901801300339454489134873273269161807133184957725631203791969744406992490029017308434294093310271973777802513443575042969796895750747614660497411432558300476234836462151925376765365205539666438199705555483194413832902302373511490858360959114097755447464088887287145428704637498873563", 0);
     mpz_init_set_str(g, "105861658449903670398842707812938888531601091401355008230876634024010937268870331311638117904636173888707058855182778532622385692236892785716421644114344195029162371175818169381366740838052666046929986716700970629216177653754852315554730008499152818656193522542478412787555437975470969140718764372166206582283", 0);
@@ -201,48 +510,262 @@ int main() {
     double cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
     printf("Precomputation for %d values took %f seconds to execute \n", PRECOMP, cpu_time_used);
 
+    //The same range as a sorted table, for batched lookups
+    DlogTable dt;
+    if (dlogInit(&dt, g, p, PRECOMP) != 0) {
+        fprintf(stderr, "Could not build the lookup table\n");
+        return 1;
+    }
+
     /*    
     gmp_printf("P = %Zd\n", p);
     gmp_printf("G = %Zd\n", g);
     gmp_printf("Q = %Zd\n", q);
     */
 
+    //Keys live in one contiguous store, U only holds views into it
     Users U[NUM];
-    genKeyPair(U, NUM, p, g);
+    KeyStore ks;
+    if (keyStoreInit(&ks, NUM, mpz_size(p)) != 0
+        || genKeyPairs(&ks, U, NUM, p, g, (int) sysconf(_SC_NPROCESSORS_ONLN)) != 0) {
+        fprintf(stderr, "Key generation failed\n");
+        return 1;
+    }
+
+    //Give every user an ID; the index maps it back to the user's slot and
+    //U[i].ID points at its interned copy
+    UserIndex ui;
+    if (userIndexInit(&ui, NUM) != 0) {
+        fprintf(stderr, "Could not build the user index\n");
+        return 1;
+    }
+    for (int i = 0; i < NUM; i++) {
+        char id[32];
+        uint32_t slot;
+        int len = snprintf(id, sizeof(id), "user%d", i);
+        if (userIndexInsert(&ui, id, len, &slot) != 0) {
+            fprintf(stderr, "Could not index %s\n", id);
+            return 1;
+        }
+        U[i].ID = ui.ids[slot];
+    }
+
+    //Persist the keys with an index on the user IDs, so the aggregator and
+    //the key authority can map the file instead of regenerating them
+    uint64_t hashes[NUM];
+    for (int i = 0; i < NUM; i++) {
+        hashes[i] = keyIdHash(U[i].ID);
+    }
+    if (keyFileWrite("keystore.bin", &ks, hashes, sfeFingerprint(p, g)) != 0)
+        fprintf(stderr, "Could not write keystore.bin\n");
 
     srand(time(NULL));   // Initialization, should only be called once.
 
     //Generate random values for test purposes
     for (int i = 0; i < NUM; i ++) {
         U[i].plaintext = rand() % 1500; 
+        for (int j = 0; j < HOURS; j++)
+            U[i].hourly[j] = rand() % 100;
         //printf("%ld\n", U[i].plaintext);
     }
     
-    unsigned long int sum = U[0].plaintext;
-     for (int i = 1; i < NUM; i ++) {
-        sum = sum + U[i].plaintext; 
+    //Some users drop out of the epoch (about 2%); the submissions of the rest
+    //arrive tagged with their ID and are routed to a slot through the index
+    Bitmap present;
+    bitmapInit(&present);
+    for (int i = 0; i < NUM; i ++) {
+        if (rand() % 50 == 0)
+            continue;
+        int64_t slot = userIndexFind(&ui, U[i].ID, strlen(U[i].ID));
+        if (slot >= 0)
+            bitmapAdd(&present, (uint32_t) slot);
+    }
+
+    unsigned long int sum = 0;
+     for (int i = 0; i < NUM; i ++) {
+        if (bitmapContains(&present, i))
+            sum = sum + U[i].plaintext; 
     }
     //printf("Total sum of %d plaintext values is = %ld\n", NUM, sum);
 
-    mpz_t msk;
-    addKeys(NUM, U, msk);
-    //gmp_printf("MSK: %Zd\n", msk);
+    //Decryption key of the users that submitted
+    SubsetSums ss;
+    mpz_t subsetMsk;
+    mpz_init(subsetMsk);
+    if (subsetInit(&ss, &ks, p) != 0) {
+        fprintf(stderr, "Could not build the block key sums\n");
+        return 1;
+    }
+    subsetMasterKey(subsetMsk, &ss, &present);
+
+    //This run's aggregate becomes the next epoch of the range store, so that
+    //is the epoch the users encrypt for. Only a missing store starts afresh;
+    //one that cannot be read is reported and left untouched.
+    uint64_t fp = sfeFingerprint(p, g);
+    RangeStore rs;
+    rangeInit(&rs, p, epoch);
+    struct stat st;
+    int ranged = 1;
+    if (stat("epochs.bin", &st) != 0 && errno == ENOENT) {
+        printf("Starting epochs.bin at epoch %llu\n", (unsigned long long) epoch);
+    } else if (rangeLoad(&rs, "epochs.bin", fp) != 0) {
+        fprintf(stderr, "Could not load epochs.bin, not updating it\n");
+        ranged = 0;
+    } else {
+        epoch = rs.firstEpoch + rs.count;
+    }
+
+    //r of the epoch comes from the epoch seed shared with the light clients.
+    //Only the simulated clients use it: aggregation and decryption below take
+    //g^r from the ciphertexts
+    unsigned char epochSeed[RNG_SEED_SIZE];
+    EpochContext ep;
+    if (epochSeedLoad(EPOCH_SEED_FILE, epochSeed) != 0 || epochInit(&ep, epoch, epochSeed, g, p) != 0) {
+        fprintf(stderr, "Could not derive the randomness of epoch %llu\n", (unsigned long long) epoch);
+        return 1;
+    }
 
     Ciphertext cipher[NUM];
-    HE_Encrypt(cipher, U, g, p, r, NUM);
+    HE_Encrypt(cipher, U, g, p, &ep, NUM);
 
     Ciphertext t_cipher;
-    addCipher(NUM, &t_cipher, cipher, g, p, r);
+    addCipher(NUM, &t_cipher, cipher, p, &present);
 
     //gmp_printf("C1.1: %Zd\n", t_cipher.firstcomp);
     //gmp_printf("C1.2: %Zd\n", t_cipher.secondcomp);
 
-    //Test out values from the Light version
-    mpz_init_set_str(c, "379528334058105121016034627665760025705129029319027921610005106020260711583476868454627687009430235907583039616987061308812579210578458186535349828049658670869435673894786680436261636919906565210530894798722431320062542276063575020431118576969422223839439113144576617755153978418354762239712988265793918947873296842274682978144546788834536644579609037958595857198384736738051851946060730182090944302911260816515785953634647009967784300914301241793153379285736621527634829191359310886467344760846193681482170193132363373225515238070189774373099780748796471977395378806237467886853183740311588104546424885878483835780396406068244926225680919990998438371606844059271121715337261038229028483733533436017492697211532587736668079361534712962087586175483755424302709104262087976197465041471551791416207611867015560833825464683097753090173656339114946517527760550193696013967010943847203972346651469623719464722661290278367171482652721583426404110518102472393495112600635847818894727400640720173188874375767038528633571325859933708730109575166387066576649187853806636871273400255171507012142905877849262422714413438698254420010574239142856470112037002726567622285297032175440075267096346034006984620011710301337272387685228200174542224437594597025022899270818093460941224588059297571722827369144428213740881427253417317728663653729054180609220149593932272985323589621665955321649920543902654944632192526019593175724464143344589672275058635602602931724760252675606260990008738323738201966071582889838155519415922021431905486039515906828721443026160", 0);
-    mpz_init_set_str(k, "2822074576029375104990065838036026006789089782697465465383236142663699154512624075839394888139849800580346168685881866205439475556050268871500859395937915014952293209948228651166009524696729243038507535307304110793328763994111109663888276658046047470229817167219182281955108949281777745742908574092749977471270", 0);
+    //Test out values from the Light version: keypair.bin holds the msk and
+    //ciphertext.bin the aggregate with its g^r; compact files are rejected
+    const char *kpath = argc > 1 ? argv[1] : "keypair.bin";
+    const char *cpath = argc > 2 ? argv[2] : "ciphertext.bin";
+
+    Ciphertext l_cipher;
+    mpz_init(k);
+    mpz_init(l_cipher.firstcomp);
+    mpz_init(l_cipher.secondcomp);
+
+    SfeHeader hdr;
+    int loaded = sfeLoad(kpath, &hdr, &k, 1) == 0 && hdr.kind == SFE_KIND_KEY && hdr.fingerprint == fp;
+
+    FILE *cp = loaded ? fopen(cpath, "rb") : NULL;
+    loaded = cp != NULL && sfeReadHeader(cp, &hdr) == 0 && hdr.fingerprint == fp
+        && epochReadCiphertext(cp, &hdr, NULL, NULL, l_cipher.firstcomp, l_cipher.secondcomp) == 0;
+    if (cp != NULL)
+        fclose(cp);
+
+    if (loaded) {
+        FE_decrypt(&l_cipher, k, p, values, l_cipher.secondcomp);         //Check out the encrypted values from the Light version
+    } else {
+        printf("No Light version output found, decrypting the local aggregate\n");
+        FE_decrypt(&t_cipher, subsetMsk, p, values, t_cipher.secondcomp);
+    }
+    mpz_clear(k);
+
+    //Per-region sums: every ciphertext goes to its region's running product
+    //and the regions are decrypted together
+    GroupTable gt;
+    if (groupInit(&gt, p) == 0) {
+        for (int i = 0; i < NUM; i++) {
+            if (!bitmapContains(&present, i))
+                continue;
+            if (groupAddCipher(&gt, i % REGIONS, cipher[i].secondcomp) != 0
+                || groupAddKey(&gt, i % REGIONS, U[i].secKey) != 0)
+                fprintf(stderr, "Could not add user %d to its region\n", i);
+        }
+
+        mpz_t plain[REGIONS];
+        for (size_t i = 0; i < gt.num; i++)
+            mpz_init(plain[i]);
+
+        if (groupDecrypt(&gt, t_cipher.firstcomp, plain) == 0) {
+            for (size_t i = 0; i < gt.num; i++)
+                printf("Region %llu: sum = %ld\n", (unsigned long long) gt.groups[i].key, lookupValue(&dt, plain[i]));
+        }
+
+        for (size_t i = 0; i < gt.num; i++)
+            mpz_clear(plain[i]);
+        groupClear(&gt);
+    }
+
+    //Tariff-weighted total of the users that submitted
+    unsigned long int tariff[NUM];
+    for (int i = 0; i < NUM; i++)
+        tariff[i] = 1 + i % TARIFFS;
+
+    Ciphertext w_cipher;
+    mpz_t wmsk;
+    mpz_init(wmsk);
+    addKeysWeighted(NUM, U, tariff, p, &present, wmsk);
+    if (addCipherWeighted(NUM, &w_cipher, cipher, tariff, p, &present) == 0) {
+        printf("Tariff-weighted total:\n");
+        FE_decrypt(&w_cipher, wmsk, p, values, w_cipher.secondcomp);
+    }
+    mpz_clear(w_cipher.firstcomp);
+    mpz_clear(w_cipher.secondcomp);
+    mpz_clear(wmsk);
+
+    //Hourly readings: one vector per user, summed coordinate-wise and
+    //decrypted with the key of the users that submitted
+    VectorCiphertext *vcipher = malloc(NUM * sizeof(VectorCiphertext));
+    if (vcipher != NULL) {
+        VectorCiphertext v_cipher;
+        long hourly[HOURS];
+
+        HE_EncryptVector(vcipher, U, g, p, &ep, NUM);
+        addCipherVector(NUM, &v_cipher, vcipher, p, &present);
+        if (FE_decryptVector(&v_cipher, subsetMsk, p, &dt, hourly) == 0) {
+            printf("Hourly sums:");
+            for (int j = 0; j < HOURS; j++)
+                printf(" %ld", hourly[j]);
+            printf("\n");
+        }
+
+        clearVector(&v_cipher);
+        for (int i = 0; i < NUM; i++)
+            clearVector(&vcipher[i]);
+        free(vcipher);
+    }
+
+    //Keep the local aggregate as the next epoch of the range store and
+    //decrypt the sum over the latest epochs from it. Epochs differ in r and
+    //users, so the store keeps each epoch's mask g^(r * msk) and a range
+    //decrypts as the ciphertext (mask product, secondcomp product) with key 1
+    mpz_t epochMask, one;
+    mpz_init(epochMask);
+    mpz_init_set_ui(one, 1);
+    mpz_powm(epochMask, t_cipher.firstcomp, subsetMsk, p);
+
+    uint64_t last = epoch;
+    if (ranged && (rangeAppend(&rs, last, t_cipher.secondcomp, epochMask) != 0
+                   || rangeSave(&rs, "epochs.bin", fp) != 0)) {
+        fprintf(stderr, "Could not update epochs.bin\n");
+        ranged = 0;
+    }
+    if (ranged) {
+        uint64_t first = last + 1 >= rs.firstEpoch + RANGE_EPOCHS ? last + 1 - RANGE_EPOCHS : rs.firstEpoch;
+        Ciphertext r_cipher;
+        mpz_init(r_cipher.firstcomp);
+        mpz_init(r_cipher.secondcomp);
+
+        if (rangeQuery(&rs, first, last, r_cipher.secondcomp, r_cipher.firstcomp) == 0) {
+            printf("Epochs %llu to %llu of epochs.bin:\n", (unsigned long long) first, (unsigned long long) last);
+            FE_decrypt(&r_cipher, one, p, values, r_cipher.secondcomp);
+        }
+
+        mpz_clear(r_cipher.firstcomp);
+        mpz_clear(r_cipher.secondcomp);
+    }
+    rangeClear(&rs);
+    mpz_clear(epochMask);
+    mpz_clear(one);
+
+    subsetClear(&ss);
+    bitmapFree(&present);
+    userIndexFree(&ui);
+    epochClear(&ep);
+    dlogClear(&dt);
 
-    //FE_decrypt(&t_cipher, msk, p, values);
-    FE_decrypt(&t_cipher, k, p, values, c);         //Check out the encrypted values from the Light version
+    printf("Arena peak: %zu bytes\n", arenaPeak());
 
     return 1;
 